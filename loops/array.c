@@ -0,0 +1,138 @@
+#define _GNU_SOURCE
+
+#include "array.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define ARRAY_ALIGNMENT 64
+#define HUGE_PAGE_SIZE (2u << 20)
+
+static int huge_pages_requested(void) {
+  const char* value = getenv("ARRAY_HUGE_PAGES");
+  return value && strcmp(value, "0") != 0;
+}
+
+array get_array(unsigned i_size, unsigned j_size, enum array_init init) {
+  array arr;
+  arr.i_size = i_size;
+  arr.j_size = j_size;
+  // Длина строки округляется вверх до 64 байт
+  size_t per_line = ARRAY_ALIGNMENT / sizeof(double);
+  arr.stride = (j_size + per_line - 1) / per_line * per_line;
+
+  size_t bytes = (size_t)i_size * arr.stride * sizeof(double);
+  int huge = huge_pages_requested();
+  size_t alignment = huge ? HUGE_PAGE_SIZE : ARRAY_ALIGNMENT;
+  bytes = (bytes + alignment - 1) / alignment * alignment;
+
+  // Память не обнуляется: первым в неё пишет параллельное заполнение ниже
+  void* data = NULL;
+  if (bytes == 0 || posix_memalign(&data, alignment, bytes) != 0) {
+    perror("Ошибка выделения памяти для массива\n");
+    exit(EXIT_FAILURE);
+  }
+#ifdef MADV_HUGEPAGE
+  if (huge)
+    madvise(data, bytes, MADV_HUGEPAGE);
+#endif
+  arr.data = data;
+
+  //подготовительная часть – заполнение некими данными тем же расписанием,
+  //что и у вычислительного цикла
+  double* a = arr.data;
+  size_t stride = arr.stride;
+  switch (init) {
+    case ARRAY_INIT_ROWS:
+#pragma omp parallel for schedule(static)
+      for (unsigned i = 0; i < i_size; i++) {
+        for (unsigned j = 0; j < j_size; j++) {
+          a[i * stride + j] = 10 * i + j;
+        }
+      }
+      break;
+    case ARRAY_INIT_COLUMNS:
+#pragma omp parallel
+      for (unsigned i = 0; i < i_size; i++) {
+#pragma omp for schedule(static) nowait
+        for (unsigned j = 0; j < j_size; j++) {
+          a[i * stride + j] = 10 * i + j;
+        }
+      }
+      break;
+    case ARRAY_INIT_NONE:
+      break;
+  }
+  return arr;
+}
+
+void free_array(array* arr) {
+  free(arr->data);
+  arr->data = NULL;
+}
+
+void write_array(const array* arr, const char* path) {
+  FILE* ff = fopen(path, "w");
+  if (!ff) {
+    perror("Ошибка открытия файла результата\n");
+    exit(EXIT_FAILURE);
+  }
+  for (unsigned i = 0; i < arr->i_size; i++) {
+    const double* row = arr->data + i * arr->stride;
+    for (unsigned j = 0; j < arr->j_size; j++) {
+      fprintf(ff, "%f ", row[j]);
+    }
+    fprintf(ff, "\n");
+  }
+  fclose(ff);
+}
+
+void report_speedup(const array* arr, const array* ref,
+                    double sequential_time, double parallel_time) {
+  for (unsigned i = 0; i < arr->i_size; i++) {
+    if (memcmp(arr->data + i * arr->stride, ref->data + i * ref->stride,
+               arr->j_size * sizeof(double)) != 0) {
+      fprintf(stderr, "Строка %u не совпадает с последовательной версией\n",
+              i);
+      exit(EXIT_FAILURE);
+    }
+  }
+  printf("Время последовательной версии: %.6f секунд\n", sequential_time);
+  printf("Время выполнения: %.6f секунд\n", parallel_time);
+  printf("Ускорение: %.2f\n", sequential_time / parallel_time);
+}
+
+strip_tiling get_strip_tiling(unsigned cols, unsigned tile_cols,
+                              unsigned min_tiles, unsigned shift,
+                              unsigned steps) {
+  strip_tiling t;
+  t.cols = cols;
+  t.shift = shift;
+  unsigned tiles = (cols + tile_cols - 1) / tile_cols;
+  if (tiles < min_tiles)
+    tiles = min_tiles;
+  if (tiles > cols)
+    tiles = cols;
+  t.tiles = tiles;
+  t.tile_cols = (cols + tiles - 1) / tiles;
+  // Сдвиг полосы за блок меньше её ширины, иначе соседние полосы перекрестятся
+  unsigned max_steps = (t.tile_cols - 1) / shift + 1;
+  if (t.tiles > 1 && steps > max_steps)
+    steps = max_steps;
+  t.steps = steps ? steps : 1;
+  return t;
+}
+
+void strip_bounds(const strip_tiling* t, unsigned tile, unsigned step,
+                  unsigned* lo, unsigned* hi) {
+  unsigned shift = t->shift * step;
+  *lo = tile == 0 ? 0 : tile * t->tile_cols - shift;
+  *hi = tile == t->tiles - 1 ? t->cols : (tile + 1) * t->tile_cols - shift;
+  // Полоса с округлённой вверх шириной может упереться в край
+  if (*lo > t->cols)
+    *lo = t->cols;
+  if (*hi > t->cols)
+    *hi = t->cols;
+}
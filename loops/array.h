@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+
+// Двумерный массив double одним непрерывным блоком. Каждая строка начинается
+// на границе 64 байт (stride кратен 8 элементам), так что строки выровнены
+// для векторных загрузок, а доступ a[i][j] не идёт через массив указателей:
+//
+//   array arr = get_array(i_size, j_size, ARRAY_INIT_ROWS);
+//   double (*a)[arr.stride] = (double (*)[arr.stride])arr.data;
+typedef struct {
+  double* data;
+  unsigned i_size;
+  unsigned j_size;
+  size_t stride;
+} array;
+
+// Распределение начального заполнения между потоками. Оно должно совпадать с
+// расписанием вычислительного цикла: страница памяти попадает на узел NUMA
+// того потока, который первым в неё пишет (first touch).
+enum array_init {
+  // omp for schedule(static) по строкам i — как в openmp.c.
+  ARRAY_INIT_ROWS,
+  // omp for schedule(static) по j внутри каждой строки — как в task1_omp.c.
+  ARRAY_INIT_COLUMNS,
+  // Без заполнения: значения 10 * i + j пишет сам вызывающий, тем же
+  // разбиением, что и у его цикла (task2_omp.c).
+  ARRAY_INIT_NONE,
+};
+
+// Выделяет массив i_size x j_size и, если init не ARRAY_INIT_NONE,
+// заполняет его значениями 10 * i + j.
+// При переменной окружения ARRAY_HUGE_PAGES=1 блок выравнивается на 2 МиБ и
+// помечается MADV_HUGEPAGE, чтобы ядро отдало его большими страницами.
+array get_array(unsigned i_size, unsigned j_size, enum array_init init);
+
+void free_array(array* arr);
+
+// Пишет массив в текстовый файл path, строка массива на строку файла.
+void write_array(const array* arr, const char* path);
+
+// Сверяет arr с результатом последовательной версии ref и печатает время
+// обеих версий и ускорение. При расхождении сообщает первую несовпавшую
+// строку и завершает программу.
+void report_speedup(const array* arr, const array* ref,
+                    double sequential_time, double parallel_time);
+
+// Полосы столбцов [0, cols) для циклов, где строка шага s блока зависит от
+// строки шага s - 1, сдвинутой на shift столбцов (task1_omp.c, task2_omp.c).
+// На шаге s полоса сдвигается на shift * s влево вслед за зависимостью и
+// читает только то, что сама написала шагом раньше, так что полосы блока
+// независимы.
+typedef struct {
+  unsigned cols;
+  unsigned tiles;
+  unsigned tile_cols;
+  unsigned shift;
+  unsigned steps;  // Шагов в блоке
+} strip_tiling;
+
+// Полосы шириной до tile_cols, не меньше min_tiles штук (если столбцов
+// хватает) и блок до steps шагов.
+strip_tiling get_strip_tiling(unsigned cols, unsigned tile_cols,
+                              unsigned min_tiles, unsigned shift,
+                              unsigned steps);
+
+// Столбцы [*lo, *hi) полосы tile на шаге step блока.
+void strip_bounds(const strip_tiling* t, unsigned tile, unsigned step,
+                  unsigned* lo, unsigned* hi);
@@ -1,8 +1,9 @@
-#include <math.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "vsin.h"
+
 void write_file(double* a, unsigned i_size, unsigned j_size) {
   FILE* ff = fopen("result.txt", "w");
   for (unsigned i = 0; i < i_size; i++) {
@@ -49,6 +50,13 @@ int main(int argc, char** argv) {
     MPI_Finalize();
     exit(EXIT_FAILURE);
   }
+  // Аргумент тот же, что в openmp.c
+  if (!vsin_arg_ok(2 * (10.0 * (i_size - 1) + j_size - 1.0))) {
+    if (rank == 0)
+      vsin_arg_error();
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+  }
 
   // Определение диапазона строк для текущего процесса
   unsigned rows_per_proc = i_size / size;
@@ -82,8 +90,9 @@ int main(int argc, char** argv) {
 
   double start = MPI_Wtime();
   for (unsigned i = 0; i < local_rows; i++) {
+#pragma omp simd
     for (unsigned j = 0; j < j_size; j++) {
-      local_array[i * j_size + j] = sin(2 * local_array[i * j_size + j]);
+      local_array[i * j_size + j] = vsin(2 * local_array[i * j_size + j]);
     }
   }
 
@@ -1,55 +1,9 @@
-#include <math.h>
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-void write_file(double** a, unsigned i_size, unsigned j_size) {
-  FILE* ff = fopen("result.txt", "w");
-  for (unsigned i = 0; i < i_size; i++) {
-    for (unsigned j = 0; j < j_size; j++) {
-      fprintf(ff, "%f ", a[i][j]);
-    }
-    fprintf(ff, "\n");
-  }
-  fclose(ff);
-}
-
-void free_array(double** a, unsigned i_size) {
-  // Освобождение каждой строки
-  for (unsigned i = 0; i < i_size; i++) {
-    free(a[i]);
-  }
-  // Освобождение массива указателей
-  free(a);
-}
-
-double** get_array(unsigned i_size, unsigned j_size) {
-  // Выделение памяти для строк массима
-  double** a = calloc(i_size, sizeof(double*));
-  if (!a) {
-    perror("Ошибка выделения памяти для строк массива\n");
-    exit(EXIT_FAILURE);
-  }
-  // Выделение памяти для каждого ряда
-  for (unsigned i = 0; i < i_size; i++) {
-    a[i] = calloc(j_size, sizeof(double));
-    if (!a[i]) {
-      perror("Ошибка выделения памяти для столбцов массива\n");
-      for (unsigned k = 0; k < i; k++) {
-        free(a[k]);
-      }
-      free(a);
-      exit(EXIT_FAILURE);
-    }
-  }
-  //подготовительная часть – заполнение некими данными
-  for (unsigned i = 0; i < i_size; i++) {
-    for (unsigned j = 0; j < j_size; j++) {
-      a[i][j] = 10 * i + j;
-    }
-  }
-  return a;
-}
+#include "array.h"
+#include "vsin.h"
 
 int main(int argc, char** argv) {
   if (argc < 3) {
@@ -63,15 +17,23 @@ int main(int argc, char** argv) {
     exit(EXIT_FAILURE);
   }
 
-  double** a = get_array(i_size, j_size);
+  // Аргумент доходит до 2 * (10 * (i_size - 1) + j_size - 1)
+  if (!vsin_arg_ok(2 * (10.0 * (i_size - 1) + j_size - 1.0))) {
+    vsin_arg_error();
+    exit(EXIT_FAILURE);
+  }
+
+  array arr = get_array(i_size, j_size, ARRAY_INIT_ROWS);
+  double(*a)[arr.stride] = (double(*)[arr.stride])arr.data;
 
   double start = omp_get_wtime();
 #pragma omp parallel
   {
-#pragma omp for schedule(static) collapse(2)
+#pragma omp for schedule(static)
     for (unsigned i = 0; i < i_size; i++) {
+#pragma omp simd
       for (unsigned j = 0; j < j_size; j++) {
-        a[i][j] = sin(2 * a[i][j]);
+        a[i][j] = vsin(2 * a[i][j]);
       }
     }
   }
@@ -79,9 +41,9 @@ int main(int argc, char** argv) {
   double elapsed_time = end - start;
   printf("Время выполнения: %.6f секунд\n", elapsed_time);
 
-  write_file(a, i_size, j_size);
+  write_array(&arr, "result.txt");
 
-  free_array(a, i_size);
+  free_array(&arr);
 
   return 0;
 }
@@ -1,54 +1,68 @@
-#include <math.h>
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
 
-void write_file(double** a, unsigned i_size, unsigned j_size) {
-  FILE* ff = fopen("result.txt", "w");
-  for (unsigned i = 0; i < i_size; i++) {
-    for (unsigned j = 0; j < j_size; j++) {
-      fprintf(ff, "%f ", a[i][j]);
-    }
-    fprintf(ff, "\n");
-  }
-  fclose(ff);
+#include "array.h"
+#include "vsin.h"
+
+// a[i][j] = sin(0.04 * a[i + 3][j - 4]) для i по возрастанию.
+//
+// Строка i читает строку i + 3 до того, как та перезаписана, поэтому три
+// строки подряд друг другу не мешают: они пишут строки группы, а читают
+// строки следующей. Весь проход — одна параллельная область. Столбцы режутся
+// на полосы, и полоса проходит блок из нескольких групп, с каждой группой
+// сдвигаясь на 4 столбца влево вслед за j - 4: ячейку строки i + 3, которую
+// прочитала группа, следующая группа той же полосы и перезаписывает, пока
+// ячейка ещё в кэше. Полосы блока друг от друга не зависят, так что барьер
+// нужен только между блоками.
+
+#define TILE_COLS 2048
+#define BLOCK_GROUPS 32
+
+// Не меньше полос, чем потоков: при schedule(static) у потока всегда одни и
+// те же полосы, как при заполнении ARRAY_INIT_COLUMNS. Группа сдвигает
+// зависимость на 4 столбца.
+static strip_tiling choose_tiling(unsigned cols) {
+  return get_strip_tiling(cols, TILE_COLS, omp_get_max_threads(), 4,
+                          BLOCK_GROUPS);
 }
 
-void free_array(double** a, unsigned i_size) {
-  // Освобождение каждой строки
-  for (unsigned i = 0; i < i_size; i++) {
-    free(a[i]);
+// Общая для обеих версий строка: встроенный в тело параллельной области
+// simd-цикл GCC собирает хуже, и на одном потоке parallel() отставала.
+__attribute__((noinline)) static void compute_row(double* dst,
+                                                  const double* src,
+                                                  unsigned lo, unsigned hi) {
+#pragma omp simd
+  for (unsigned j = lo; j < hi; j++) {
+    dst[j] = vsin(0.04 * src[j - 4]);
   }
-  // Освобождение массива указателей
-  free(a);
 }
 
-double** get_array(unsigned i_size, unsigned j_size) {
-  // Выделение памяти для строк массима
-  double** a = calloc(i_size, sizeof(double*));
-  if (!a) {
-    perror("Ошибка выделения памяти для строк массива\n");
-    exit(EXIT_FAILURE);
-  }
-  // Выделение памяти для каждого ряда
-  for (unsigned i = 0; i < i_size; i++) {
-    a[i] = calloc(j_size, sizeof(double));
-    if (!a[i]) {
-      perror("Ошибка выделения памяти для столбцов массива\n");
-      for (unsigned k = 0; k < i; k++) {
-        free(a[k]);
+static void sequential(double* data, size_t stride, unsigned i_size,
+                       unsigned j_size) {
+  for (unsigned i = 0; i < i_size - 3; i++)
+    compute_row(data + i * stride, data + (i + 3) * stride, 4, j_size);
+}
+
+static void parallel(double* data, size_t stride, unsigned i_size,
+                     strip_tiling t) {
+  unsigned rows = i_size - 3;
+  unsigned block_rows = 3 * t.steps;
+#pragma omp parallel
+  for (unsigned i0 = 0; i0 < rows; i0 += block_rows) {
+#pragma omp for schedule(static)
+    for (unsigned tile = 0; tile < t.tiles; tile++) {
+      for (unsigned g = 0; g < t.steps; g++) {
+        unsigned lo, hi;
+        strip_bounds(&t, tile, g, &lo, &hi);
+        // Полосы нумеруют столбцы с j = 4
+        lo += 4;
+        hi += 4;
+        for (unsigned i = i0 + 3 * g; i < i0 + 3 * g + 3 && i < rows; i++)
+          compute_row(data + i * stride, data + (i + 3) * stride, lo, hi);
       }
-      free(a);
-      exit(EXIT_FAILURE);
-    }
-  }
-  //подготовительная часть – заполнение некими данными
-  for (unsigned i = 0; i < i_size; i++) {
-    for (unsigned j = 0; j < j_size; j++) {
-      a[i][j] = 10 * i + j;
     }
   }
-  return a;
 }
 
 int main(int argc, char** argv) {
@@ -58,27 +72,28 @@ int main(int argc, char** argv) {
   }
   unsigned i_size = strtoul(argv[1], NULL, 10);
   unsigned j_size = strtoul(argv[2], NULL, 10);
-  if (i_size <= 0 || j_size < -0) {
+  if (i_size <= 3 || j_size <= 4) {
     fprintf(stderr, "Недопустимое значение размера.\n");
     exit(EXIT_FAILURE);
   }
 
-  double** a = get_array(i_size, j_size);
-
+  array ref = get_array(i_size, j_size, ARRAY_INIT_COLUMNS);
   double start = omp_get_wtime();
-  for (unsigned i = 0; i < i_size - 3; i++) {
-#pragma omp parallel for schedule(static)
-    for (unsigned j = 4; j < j_size; j++) {
-      a[i][j] = sin(0.04 * a[i + 3][j - 4]);
-    }
-  }
-  double end = omp_get_wtime();
-  double elapsed_time = end - start;
-  printf("Время выполнения: %.6f секунд\n", elapsed_time);
+  sequential(ref.data, ref.stride, i_size, j_size);
+  double sequential_time = omp_get_wtime() - start;
+
+  strip_tiling t = choose_tiling(j_size - 4);
+  array arr = get_array(i_size, j_size, ARRAY_INIT_COLUMNS);
+  start = omp_get_wtime();
+  parallel(arr.data, arr.stride, i_size, t);
+  double parallel_time = omp_get_wtime() - start;
+
+  report_speedup(&arr, &ref, sequential_time, parallel_time);
 
-  write_file(a, i_size, j_size);
+  write_array(&arr, "result.txt");
 
-  free_array(a, i_size);
+  free_array(&ref);
+  free_array(&arr);
 
   return 0;
 }
@@ -1,124 +1,342 @@
-#include <math.h>
+#include <limits.h>
 #include <mpi.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-void write_file(double* a, unsigned i_size, unsigned j_size) {
+#include "vsin.h"
+
+// MPI-версия seq2.c: a[i][j] = sin(3 * a[i - 3][j + 2]).
+//
+// Массив делится на полосы столбцов, и каждый процесс хранит только свою
+// полосу и два столбца правого соседа (ореол), так что память на процесс
+// падает как 1/P. Строки обходятся блоками по block_rows; за блок процесс
+// обменивается с соседями одним сообщением вместо сообщения на строку:
+//   1. левый край блока, который нужен соседу слева, считается первым и
+//      сразу уходит через MPI_Isend, а ореол блока от соседа справа
+//      принимается через MPI_Irecv;
+//   2. пока сообщения идут, считается середина полосы;
+//   3. после MPI_Waitall — правый край, который читает ореол этого блока.
+// Зависимость сдвигается на 2 столбца за 3 строки, так что и левый, и правый
+// края — трапеции; блок уменьшается, если на узкой полосе они пересекутся.
+// Полоса не уже двух столбцов, чтобы ореол лежал у одного соседа: если
+// столбцов меньше, чем 2 * P, лишние процессы остаются без полосы.
+// Процесс 0 сверяет собранный массив с последовательной версией и печатает
+// ускорение относительно неё.
+
+#define BLOCK_ROWS 48
+
+// Процессы, между которыми делятся столбцы.
+static int active_ranks(unsigned j_size, int size) {
+  return j_size / 2 < (unsigned)size ? (int)(j_size / 2) : size;
+}
+
+static void column_range(unsigned j_size, int size, int rank,
+                         unsigned* start_col, unsigned* cols) {
+  int active = active_ranks(j_size, size);
+  if (rank >= active) {
+    *start_col = j_size;
+    *cols = 0;
+    return;
+  }
+  unsigned cols_per_proc = j_size / active;
+  unsigned extra_cols = j_size % active;
+  *start_col = rank * cols_per_proc +
+               ((unsigned)rank < extra_cols ? (unsigned)rank : extra_cols);
+  *cols = cols_per_proc + ((unsigned)rank < extra_cols ? 1 : 0);
+}
+
+// Процесс 0 собирает полосы блоками по gather_rows строк: в блоке из rows
+// строк полоса процесса r лежит с rows * start_col подряд, по cols на строку.
+// Строки файла читаются прямо оттуда.
+static const double* gathered_row(const double* a, unsigned i_size,
+                                  unsigned j_size, unsigned gather_rows,
+                                  unsigned i, unsigned start_col,
+                                  unsigned cols) {
+  unsigned b0 = i - i % gather_rows;
+  unsigned rows = i_size - b0 < gather_rows ? i_size - b0 : gather_rows;
+  return a + (size_t)b0 * j_size + (size_t)rows * start_col +
+         (size_t)(i - b0) * cols;
+}
+
+void write_file(const double* a, unsigned i_size, unsigned j_size, int size,
+                unsigned gather_rows) {
   FILE* ff = fopen("result.txt", "w");
   for (unsigned i = 0; i < i_size; i++) {
-    for (unsigned j = 0; j < j_size; j++) {
-      fprintf(ff, "%f ", a[i * j_size + j]);
+    for (int r = 0; r < size; r++) {
+      unsigned start_col, cols;
+      column_range(j_size, size, r, &start_col, &cols);
+      const double* row =
+          gathered_row(a, i_size, j_size, gather_rows, i, start_col, cols);
+      for (unsigned j = 0; j < cols; j++) {
+        fprintf(ff, "%f ", row[j]);
+      }
     }
     fprintf(ff, "\n");
   }
   fclose(ff);
 }
 
-double* get_array(unsigned rows, unsigned cols) {
-  double* a = calloc(rows * cols, sizeof(double));
-  if (!a) {
+// Полоса столбцов [start_col, start_col + cols) и ореол справа от неё.
+typedef struct {
+  double* a;
+  unsigned rows;
+  unsigned cols;
+  size_t stride;  // cols + 2
+  unsigned start_col;
+  // Как в seq2.c, последние два столбца массива не пересчитываются
+  unsigned computed;
+  int has_right;
+} slab;
+
+static slab get_slab(unsigned i_size, unsigned j_size, int size, int rank) {
+  slab s;
+  s.rows = i_size;
+  column_range(j_size, size, rank, &s.start_col, &s.cols);
+  s.stride = s.cols + 2;
+  unsigned end_col = s.start_col + s.cols;
+  if (s.cols == 0)
+    s.computed = 0;
+  else
+    s.computed = end_col <= j_size - 2 ? s.cols : j_size - 2 - s.start_col;
+  s.has_right = rank < active_ranks(j_size, size) - 1;
+
+  s.a = malloc((size_t)i_size * s.stride * sizeof(double));
+  if (!s.a) {
+    perror("Ошибка выделения памяти для массива\n");
+    exit(EXIT_FAILURE);
+  }
+  // Ореол заполняется так же: для первых трёх строк он не пересылается
+  unsigned width = s.has_right ? s.cols + 2 : s.cols;
+  for (unsigned i = 0; i < i_size; i++) {
+    for (unsigned j = 0; j < width; j++) {
+      s.a[i * s.stride + j] = 10 * i + s.start_col + j;  // Инициализация
+    }
+  }
+  return s;
+}
+
+static void compute_row(const slab* s, unsigned i, unsigned lo, unsigned hi) {
+  double* dst = s->a + i * s->stride;
+  const double* src = s->a + (i - 3) * s->stride + 2;
+#pragma omp simd
+  for (unsigned j = lo; j < hi; j++) {
+    dst[j] = vsin(3 * src[j]);
+  }
+}
+
+// Последовательная версия seq2.c на процессе 0. Строка i читает только
+// строку i - 3, поэтому хватает кольца из четырёх строк, а не второго
+// массива; каждая строка сравнивается с собранной. В *seconds — время
+// вычисления без сравнений. Кольцо лежит в кэше, так что ускорение
+// получается скорее заниженным. Возвращает первую несовпавшую строку или
+// i_size.
+static unsigned check_sequential(const double* a, unsigned i_size,
+                                 unsigned j_size, int size,
+                                 unsigned gather_rows, double* seconds) {
+  double* ring = malloc(4 * (size_t)j_size * sizeof(double));
+  if (!ring) {
     perror("Ошибка выделения памяти для массива\n");
     exit(EXIT_FAILURE);
   }
-  for (unsigned i = 0; i < rows; i++) {
-    for (unsigned j = 0; j < cols; j++) {
-      a[i * cols + j] = 10 * i + j;  // Инициализация
+  *seconds = 0;
+  unsigned i = 0;
+  for (; i < i_size; i++) {
+    double* dst = ring + (i % 4) * (size_t)j_size;
+    if (i < 3) {
+      for (unsigned j = 0; j < j_size; j++)
+        dst[j] = 10 * i + j;
+    } else {
+      // Как в seq2.c, последние два столбца не пересчитываются
+      dst[j_size - 2] = 10 * i + j_size - 2;
+      dst[j_size - 1] = 10 * i + j_size - 1;
+      const double* src = ring + ((i - 3) % 4) * (size_t)j_size + 2;
+      double start = MPI_Wtime();
+#pragma omp simd
+      for (unsigned j = 0; j < j_size - 2; j++) {
+        dst[j] = vsin(3 * src[j]);
+      }
+      *seconds += MPI_Wtime() - start;
+    }
+
+    int same = 1;
+    for (int r = 0; r < size && same; r++) {
+      unsigned start_col, cols;
+      column_range(j_size, size, r, &start_col, &cols);
+      const double* row =
+          gathered_row(a, i_size, j_size, gather_rows, i, start_col, cols);
+      same = memcmp(row, dst + start_col, cols * sizeof(double)) == 0;
     }
+    if (!same)
+      break;
   }
-  return a;
+  free(ring);
+  return i;
+}
+
+// Конец левого края в строке t блока из rows строк: столбцы, от которых
+// зависят столбцы 0 и 1 последних строк блока.
+static unsigned left_end(const slab* s, unsigned rows, unsigned t) {
+  unsigned end = 2 + 2 * ((rows - 1 - t) / 3);
+  return end < s->computed ? end : s->computed;
+}
+
+// Начало правого края в строке t: столбцы, которые через t / 3 шагов
+// зависимости читают ореол строк этого же блока.
+static unsigned right_start(const slab* s, unsigned t) {
+  if (!s->has_right)
+    return s->computed;
+  unsigned shift = 2 * (t / 3);
+  unsigned start = shift < s->cols ? s->cols - shift : 0;
+  return start < s->computed ? start : s->computed;
+}
+
+// Наибольший блок не выше block_rows, в котором края не пересекаются.
+static unsigned fit_block(const slab* s, unsigned block_rows) {
+  for (unsigned rows = block_rows; rows > 1; rows--) {
+    unsigned t = 3;
+    while (t < rows && left_end(s, rows, t) <= right_start(s, t))
+      t++;
+    if (t >= rows)
+      return rows;
+  }
+  return 1;
 }
 
 int main(int argc, char** argv) {
   MPI_Init(&argc, &argv);
-  MPI_Status status;
 
   int rank, size;
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &size);
 
   if (argc < 3) {
-    fprintf(stderr, "Запуск: %s <i_size> <j_size>\n", argv[0]);
+    if (rank == 0)
+      fprintf(stderr, "Запуск: %s <i_size> <j_size> [block_rows]\n", argv[0]);
+    MPI_Finalize();
     exit(EXIT_FAILURE);
   }
   unsigned i_size = strtoul(argv[1], NULL, 10);
   unsigned j_size = strtoul(argv[2], NULL, 10);
-  if (i_size <= 0 || j_size < -0) {
-    fprintf(stderr, "Недопустимое значение размера.\n");
+  unsigned block_rows = argc > 3 ? strtoul(argv[3], NULL, 10) : BLOCK_ROWS;
+  if (i_size == 0 || j_size < 2 || block_rows == 0) {
+    if (rank == 0)
+      fprintf(stderr, "Недопустимое значение размера.\n");
+    MPI_Finalize();
     exit(EXIT_FAILURE);
   }
+  // Аргумент тот же, что в seq2.c
+  if (!vsin_arg_ok(3 * (20.0 + j_size - 1.0))) {
+    if (rank == 0)
+      vsin_arg_error();
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+  }
+
+  slab s = get_slab(i_size, j_size, size, rank);
+  unsigned local_block = fit_block(&s, block_rows);
+  MPI_Allreduce(&local_block, &block_rows, 1, MPI_UNSIGNED, MPI_MIN,
+                MPI_COMM_WORLD);
+  double* halo_out = malloc(2 * block_rows * sizeof(double));
+  double* halo_in = malloc(2 * block_rows * sizeof(double));
+
+  double start = MPI_Wtime();
+  for (unsigned i0 = 3; i0 < i_size; i0 += block_rows) {
+    unsigned rows = i_size - i0 < block_rows ? i_size - i0 : block_rows;
+    MPI_Request requests[2];
+    int pending = 0;
+    if (s.has_right)
+      MPI_Irecv(halo_in, 2 * rows, MPI_DOUBLE, rank + 1, 0, MPI_COMM_WORLD,
+                &requests[pending++]);
+
+    for (unsigned t = 0; t < rows; t++)
+      compute_row(&s, i0 + t, 0, left_end(&s, rows, t));
+    if (rank != 0 && s.cols != 0) {
+      for (unsigned t = 0; t < rows; t++) {
+        halo_out[2 * t] = s.a[(i0 + t) * s.stride];
+        halo_out[2 * t + 1] = s.a[(i0 + t) * s.stride + 1];
+      }
+      MPI_Isend(halo_out, 2 * rows, MPI_DOUBLE, rank - 1, 0, MPI_COMM_WORLD,
+                &requests[pending++]);
+    }
+
+    for (unsigned t = 0; t < rows; t++)
+      compute_row(&s, i0 + t, left_end(&s, rows, t), right_start(&s, t));
 
-  double* a = get_array(i_size, j_size);
+    MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+    if (s.has_right) {
+      for (unsigned t = 0; t < rows; t++) {
+        s.a[(i0 + t) * s.stride + s.cols] = halo_in[2 * t];
+        s.a[(i0 + t) * s.stride + s.cols + 1] = halo_in[2 * t + 1];
+      }
+    }
 
-  // Определение диапазона столбцов для текущего процесса
-  int cols_per_proc = j_size / size;
-  int extra_cols = j_size % size;
-  int start_col =
-      rank * cols_per_proc + (rank < extra_cols ? rank : extra_cols);
-  int end_col = start_col + cols_per_proc + (rank < extra_cols ? 1 : 0);
-  int local_cols = end_col - start_col;
+    for (unsigned t = 0; t < rows; t++)
+      compute_row(&s, i0 + t, right_start(&s, t), s.computed);
+  }
 
+  // Полосы собираются на процессе 0 как есть, без ореола. Сборка идёт
+  // блоками строк, чтобы int-счётчики и смещения MPI_Gatherv не
+  // переполнялись: блок — не больше INT_MAX чисел
+  unsigned gather_rows = INT_MAX / j_size;
+  if (gather_rows > i_size)
+    gather_rows = i_size;
   int *recv_counts = NULL, *displs = NULL;
   double* gathered_a = NULL;
   if (rank == 0) {
     recv_counts = malloc(size * sizeof(int));
     displs = malloc(size * sizeof(int));
-    gathered_a = malloc(i_size * j_size * sizeof(double));
-    int offset = 0;
-    for (int i = 0; i < size; i++) {
-      recv_counts[i] = local_cols * i_size;
-      displs[i] = offset;
-      offset += recv_counts[i];
+    gathered_a = malloc((size_t)i_size * j_size * sizeof(double));
+    if (!recv_counts || !displs || !gathered_a) {
+      perror("Ошибка выделения памяти для массива\n");
+      exit(EXIT_FAILURE);
     }
   }
 
-  double start = MPI_Wtime();
-  for (unsigned i = 3; i < i_size; i++) {
-    for (unsigned j = start_col; j < end_col; j++) {
-      a[i * j_size + j] = sin(3 * a[(i - 3) * j_size + (j + 2)]);
-    }
-    // Обмен на границе
-    // 3 -> 2 | 1 -> 0
-    // 2 -> 1 |
-    if (rank % 2 == 0) {
-      if (rank != size - 1)
-        MPI_Recv(&a[i * j_size + end_col], 2, MPI_DOUBLE, rank + 1, 0,
-                 MPI_COMM_WORLD, &status);
-      if (rank != 0)
-        MPI_Send(&a[i * j_size + start_col], 2, MPI_DOUBLE, rank - 1, 0,
-                 MPI_COMM_WORLD);
-    } else {
-      MPI_Send(&a[i * j_size + start_col], 2, MPI_DOUBLE, rank - 1, 0,
-               MPI_COMM_WORLD);
-      if (rank != size - 1)
-        MPI_Recv(&a[i * j_size + end_col], 2, MPI_DOUBLE, rank + 1, 0,
-                 MPI_COMM_WORLD, &status);
+  for (unsigned b0 = 0; b0 < i_size; b0 += gather_rows) {
+    unsigned rows = i_size - b0 < gather_rows ? i_size - b0 : gather_rows;
+    if (rank == 0) {
+      for (int r = 0; r < size; r++) {
+        unsigned start_col, cols;
+        column_range(j_size, size, r, &start_col, &cols);
+        recv_counts[r] = rows * cols;
+        displs[r] = rows * start_col;
+      }
     }
+    MPI_Datatype slab_type;
+    MPI_Type_vector(rows, s.cols, s.stride, MPI_DOUBLE, &slab_type);
+    MPI_Type_commit(&slab_type);
+    MPI_Gatherv(s.a + (size_t)b0 * s.stride, 1, slab_type,
+                rank == 0 ? gathered_a + (size_t)b0 * j_size : NULL,
+                recv_counts, displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Type_free(&slab_type);
   }
-  MPI_Barrier(MPI_COMM_WORLD);
-
-  // Локальный массив отправляем
-  double* sendbuf = malloc(local_cols * i_size * sizeof(double));
-  for (unsigned i = 0; i < i_size; i++) {
-    memcpy(&sendbuf[i * local_cols], &a[i * j_size + start_col],
-           local_cols * sizeof(double));
-  }
-
-  MPI_Gatherv(sendbuf, local_cols * i_size, MPI_DOUBLE, gathered_a, recv_counts,
-              displs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
   double end = MPI_Wtime();
   if (rank == 0) {
     double elapsed_time = end - start;
+    double sequential_time;
+    unsigned bad_row = check_sequential(gathered_a, i_size, j_size, size,
+                                        gather_rows, &sequential_time);
+    if (bad_row < i_size) {
+      fprintf(stderr, "Строка %u не совпадает с последовательной версией\n",
+              bad_row);
+      MPI_Finalize();
+      exit(EXIT_FAILURE);
+    }
+    printf("Время последовательной версии: %.6f секунд\n", sequential_time);
     printf("Время выполнения: %.6f секунд\n", elapsed_time);
-    write_file(gathered_a, i_size, j_size);
+    printf("Ускорение: %.2f\n", sequential_time / elapsed_time);
+
+    write_file(gathered_a, i_size, j_size, size, gather_rows);
     free(gathered_a);
     free(recv_counts);
     free(displs);
   }
 
-  free(sendbuf);
-  free(a);
+  free(halo_out);
+  free(halo_in);
+  free(s.a);
   MPI_Finalize();
 
   return 0;
@@ -0,0 +1,126 @@
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "array.h"
+#include "vsin.h"
+
+// Параллельная версия seq2.c: a[i][j] = sin(3 * a[i - 3][j + 2]).
+//
+// Строка i зависит только от строки i - 3, поэтому строки делятся на три
+// независимые цепочки (i mod 3), а внутри строки все j независимы. Строки
+// обходятся блоками; в блоке каждая цепочка режется на полосы столбцов,
+// которые с каждым шагом цепочки сдвигаются на 2 влево вслед за
+// зависимостью. Тогда полоса читает только свои же значения с прошлого шага
+// или строки прошлых блоков, и все полосы всех трёх цепочек блока считаются
+// независимо, без синхронизации внутри блока. Высота блока подобрана так,
+// чтобы полоса за все свои шаги помещалась в L2.
+
+#define L2_BYTES (256 * 1024)
+#define TILE_COLS 1024
+
+// Полосы для трёх цепочек: полос в цепочке хватает, чтобы занять все потоки,
+// а шаг цепочки сдвигает зависимость на 2 столбца.
+static strip_tiling choose_tiling(unsigned j_end, unsigned block_rows,
+                                  unsigned tile_cols) {
+  unsigned threads = omp_get_max_threads();
+  // За шаг полоса пишет tile_cols значений и читает столько же
+  unsigned steps = block_rows ? block_rows / 3
+                              : L2_BYTES / (2 * tile_cols * sizeof(double));
+  return get_strip_tiling(j_end, tile_cols, (threads + 2) / 3, 2, steps);
+}
+
+static void sequential(double* data, size_t stride, unsigned i_size,
+                       unsigned j_size) {
+  for (unsigned i = 3; i < i_size; i++) {
+    double* dst = data + i * stride;
+    const double* src = data + (i - 3) * stride + 2;
+#pragma omp simd
+    for (unsigned j = 0; j < j_size - 2; j++) {
+      dst[j] = vsin(3 * src[j]);
+    }
+  }
+}
+
+// Обход блоков, цепочек и полос. С fill он не считает строки, а заполняет
+// массив значениями 10 * i + j, начиная со строки 0 и до последнего столбца:
+// каждую страницу первым трогает тот же поток, что потом её считает.
+static void sweep(double* data, size_t stride, unsigned i_size,
+                  unsigned j_size, strip_tiling t, int fill) {
+  unsigned block_rows = 3 * t.steps;
+#pragma omp parallel
+  for (unsigned i0 = fill ? 0 : 3; i0 < i_size; i0 += block_rows) {
+#pragma omp for collapse(2) schedule(static)
+    for (unsigned chain = 0; chain < 3; chain++) {
+      for (unsigned tile = 0; tile < t.tiles; tile++) {
+        for (unsigned s = 0; s < t.steps; s++) {
+          unsigned i = i0 + chain + 3 * s;
+          if (i >= i_size)
+            break;
+          unsigned lo, hi;
+          strip_bounds(&t, tile, s, &lo, &hi);
+          double* dst = data + i * stride;
+          if (fill) {
+            // Два последних столбца не считаются, но заполнить их надо
+            if (tile == t.tiles - 1)
+              hi = j_size;
+            for (unsigned j = lo; j < hi; j++) {
+              dst[j] = 10 * i + j;
+            }
+            continue;
+          }
+          const double* src = data + (i - 3) * stride + 2;
+#pragma omp simd
+          for (unsigned j = lo; j < hi; j++) {
+            dst[j] = vsin(3 * src[j]);
+          }
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    fprintf(stderr, "Запуск: %s <i_size> <j_size> [block_rows] [tile_cols]\n",
+            argv[0]);
+    exit(EXIT_FAILURE);
+  }
+  unsigned i_size = strtoul(argv[1], NULL, 10);
+  unsigned j_size = strtoul(argv[2], NULL, 10);
+  unsigned block_rows = argc > 3 ? strtoul(argv[3], NULL, 10) : 0;
+  unsigned tile_cols = argc > 4 ? strtoul(argv[4], NULL, 10) : TILE_COLS;
+  if (i_size <= 3 || j_size <= 2 || tile_cols == 0) {
+    fprintf(stderr, "Недопустимое значение размера.\n");
+    exit(EXIT_FAILURE);
+  }
+
+  // Аргумент тот же, что в seq2.c
+  if (!vsin_arg_ok(3 * (20.0 + j_size - 1.0))) {
+    vsin_arg_error();
+    exit(EXIT_FAILURE);
+  }
+  strip_tiling t = choose_tiling(j_size - 2, block_rows, tile_cols);
+
+  array ref = get_array(i_size, j_size, ARRAY_INIT_ROWS);
+  double start = omp_get_wtime();
+  sequential(ref.data, ref.stride, i_size, j_size);
+  double sequential_time = omp_get_wtime() - start;
+
+  array arr = get_array(i_size, j_size, ARRAY_INIT_NONE);
+  sweep(arr.data, arr.stride, i_size, j_size, t, 1);
+  start = omp_get_wtime();
+  sweep(arr.data, arr.stride, i_size, j_size, t, 0);
+  double parallel_time = omp_get_wtime() - start;
+
+  printf("Блок: %u строк, %u полос по %u столбцов\n", 3 * t.steps, t.tiles,
+         t.tile_cols);
+  report_speedup(&arr, &ref, sequential_time, parallel_time);
+
+  write_array(&arr, "result.txt");
+
+  free_array(&ref);
+  free_array(&arr);
+
+  return 0;
+}
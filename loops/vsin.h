@@ -0,0 +1,148 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Синус для тел циклов, который векторизуется вместе с циклом:
+//
+//   #pragma omp simd
+//   for (unsigned j = 0; j < j_size; j++)
+//     a[i][j] = vsin(2 * a[i][j]);
+//
+// Вызов libm sin в таком цикле остаётся скалярным, а vsin — это только
+// арифметика и выбор без ветвлений, поэтому компилятор разворачивает её в
+// векторные команды той ширины, что позволяет -march: SSE2, AVX2 или AVX-512.
+// Для вызовов, которые не встроились, #pragma omp declare simd даёт векторные
+// клоны функции. Без -fopenmp или -fopenmp-simd прагмы игнорируются и vsin
+// работает как обычная скалярная функция.
+//
+// Аргумент приводится к r = x - k·π/2, |r| <= π/4 (Коди — Уэйт), и синус
+// или косинус r считается многочленами из fdlibm; четверть k mod 4 выбирает
+// между ними и знак.
+//
+// По умолчанию (строгий режим) остаток r считается с хвостом rr так, что
+// r + rr отличается от x - k·π/2 меньше чем на ulp(r) даже у кратных π/2,
+// и многочлены учитывают rr: результат отличается от libm не больше чем на
+// 1 ulp. С -DVSIN_FAST хвост не считается: ошибка вырастает до нескольких
+// ulp, а рядом с кратными π/2 при больших |x| — больше. Обе оценки
+// проверяет vsin_check.c.
+//
+// Область определения: |x| <= VSIN_MAX_ARG. Дальше произведения k на части
+// π/2 перестают быть точными, и результат неверен; бесконечность и NaN дают
+// NaN. Проверки внутри нет, иначе цикл не векторизуется: программы сами
+// отказываются (vsin_arg_ok) от размеров, при которых аргумент выходит за
+// границу (в task1_omp.c он не больше 0.04 · 2^32 при любых размерах).
+
+#define VSIN_MAX_ARG 0x1p28
+
+// Проверка размеров в программах: max_arg — наибольший |x|, который увидит
+// их цикл.
+static inline int vsin_arg_ok(double max_arg) {
+  return max_arg <= VSIN_MAX_ARG;
+}
+
+static inline void vsin_arg_error(void) {
+  fprintf(stderr, "Слишком большой массив: аргумент синуса больше %g.\n",
+          VSIN_MAX_ARG);
+}
+
+// π/2 = VSIN_PIO2_1 + ... + VSIN_PIO2_5. В первых четырёх частях по 24
+// значащих бита, так что k·VSIN_PIO2_n точно при |k| < 2^29.
+#define VSIN_PIO2_1 0x1.921fb6p+0
+#define VSIN_PIO2_2 -0x1.777a5cp-25
+#define VSIN_PIO2_3 -0x1.ee59dap-50
+#define VSIN_PIO2_4 0x1.98a2ep-77
+#define VSIN_PIO2_5 0x1.b839a252049c1p-104
+#define VSIN_2_OVER_PI 0x1.45f306dc9c883p-1
+// Прибавление 1.5·2^52 округляет до целого и кладёт его в младшие биты
+// мантиссы.
+#define VSIN_ROUND 0x1.8p52
+
+#define VSIN_S1 -1.66666666666666324348e-01
+#define VSIN_S2 8.33333333332248946124e-03
+#define VSIN_S3 -1.98412698298579493134e-04
+#define VSIN_S4 2.75573137070700676789e-06
+#define VSIN_S5 -2.50507602534068634195e-08
+#define VSIN_S6 1.58969099521155010221e-10
+
+#define VSIN_C1 4.16666666666666019037e-02
+#define VSIN_C2 -1.38888888888741095749e-03
+#define VSIN_C3 2.48015872894767294178e-05
+#define VSIN_C4 -2.75573143513906633035e-07
+#define VSIN_C5 2.08757232129817482790e-09
+#define VSIN_C6 -1.13596475577881948265e-11
+
+typedef union {
+  double d;
+  uint64_t u;
+} vsin_bits;
+
+// sin(r + rr) при |r| <= π/4 (__kernel_sin из fdlibm).
+static inline double vsin_kernel_sin(double r, double rr) {
+  double z = r * r;
+  double w = z * z;
+  double p = VSIN_S2 + z * (VSIN_S3 + z * VSIN_S4) +
+             z * w * (VSIN_S5 + z * VSIN_S6);
+  double v = z * r;
+#ifdef VSIN_FAST
+  (void)rr;
+  return r + v * (VSIN_S1 + z * p);
+#else
+  return r - ((z * (0.5 * rr - v * p) - rr) - v * VSIN_S1);
+#endif
+}
+
+// cos(r + rr) при |r| <= π/4 (__kernel_cos из fdlibm).
+static inline double vsin_kernel_cos(double r, double rr) {
+  double z = r * r;
+  double w = z * z;
+  double p = z * (VSIN_C1 + z * (VSIN_C2 + z * VSIN_C3)) +
+             w * w * (VSIN_C4 + z * (VSIN_C5 + z * VSIN_C6));
+  double hz = 0.5 * z;
+  double one_hz = 1.0 - hz;
+#ifdef VSIN_FAST
+  (void)rr;
+  return one_hz + (((1.0 - one_hz) - hz) + z * p);
+#else
+  return one_hz + (((1.0 - one_hz) - hz) + (z * p - r * rr));
+#endif
+}
+
+// hi - w без потери: *hi получает округлённую разность, возвращается её
+// ошибка (TwoSum Кнута).
+static inline double vsin_sub(double* hi, double w) {
+  double a = *hi;
+  double s = a - w;
+  double bb = s - a;
+  *hi = s;
+  return (a - (s - bb)) - (w + bb);
+}
+
+#pragma omp declare simd notinbranch
+static inline double vsin(double x) {
+  vsin_bits y = {x * VSIN_2_OVER_PI + VSIN_ROUND};
+  double k = y.d - VSIN_ROUND;
+  uint64_t quadrant = y.u;
+
+  // x - k·VSIN_PIO2_1 точно: оба слагаемых одного порядка.
+  double r = x - k * VSIN_PIO2_1;
+#ifdef VSIN_FAST
+  r = r - k * VSIN_PIO2_2;
+  r = r - k * VSIN_PIO2_3;
+  r = r - k * VSIN_PIO2_4;
+  double rr = 0;
+#else
+  double lo = vsin_sub(&r, k * VSIN_PIO2_2);
+  lo += vsin_sub(&r, k * VSIN_PIO2_3);
+  lo += vsin_sub(&r, k * VSIN_PIO2_4);
+  lo -= k * VSIN_PIO2_5;
+  double hi = r;
+  r = hi + lo;
+  double rr = (hi - r) + lo;
+#endif
+
+  vsin_bits result = {(quadrant & 1) ? vsin_kernel_cos(r, rr)
+                                     : vsin_kernel_sin(r, rr)};
+  result.u ^= (quadrant & 2) << 62;
+  return result.d;
+}
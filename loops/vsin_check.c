@@ -0,0 +1,174 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "vsin.h"
+
+// Сравнивает vsin с sin из libm на аргументах, которые видят циклы
+// openmp.c, mpi.c, seq2.c, task1_omp.c и task2_mpi.c, и на всей области
+// определения. Печатает для каждого набора наибольшую разницу в ulp и время
+// на элемент; в строгом режиме завершается с ошибкой, если разница где-то
+// больше 1 ulp.
+
+typedef struct {
+  const char* name;
+  void (*fill)(double* x, size_t n);
+} argument_set;
+
+// 2 * (10i + j): openmp.c и mpi.c.
+static void fill_doubled(double* x, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = 2.0 * i;
+}
+
+// 3 * (10i + j) в первых строках seq2.c и task2_mpi.c.
+static void fill_tripled(double* x, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = 3.0 * i;
+}
+
+// 3 * sin(...) в остальных строках seq2.c и task2_mpi.c.
+static void fill_tripled_sin(double* x, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = 3 * sin(3.0 * i);
+}
+
+// 0.04 * (10i + j): task1_omp.c.
+static void fill_scaled(double* x, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    x[i] = 0.04 * i;
+}
+
+static uint64_t random_state = 0x9e3779b97f4a7c15u;
+
+static uint64_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 7;
+  random_state ^= random_state << 17;
+  return random_state;
+}
+
+static double random_unit(void) {
+  return (next_random() >> 11) * 0x1p-53;
+}
+
+// Случайные ±2^e с e от -30 до log2(VSIN_MAX_ARG): вся область определения.
+static void fill_random(double* x, size_t n) {
+  double top = log2(VSIN_MAX_ARG);
+  for (size_t i = 0; i < n; i++) {
+    double value = exp2(-30 + (top + 30) * random_unit());
+    x[i] = next_random() & 1 ? -value : value;
+  }
+}
+
+// Последние числа области, |x| <= VSIN_MAX_ARG, с чередованием знака.
+static void fill_boundary(double* x, size_t n) {
+  double value = VSIN_MAX_ARG;
+  for (size_t i = 0; i < n; i++) {
+    x[i] = i & 1 ? -value : value;
+    value = nextafter(value, 0);
+  }
+}
+
+// Ближайшие к k·π/2 числа: здесь остаток r сокращается сильнее всего.
+static void fill_near_pio2(double* x, size_t n) {
+  const long double pio2 = 1.570796326794896619231321691639751442L;
+  double k_max = VSIN_MAX_ARG / pio2;
+  for (size_t i = 0; i < n; i++) {
+    double k = floor(1 + (k_max - 1) * random_unit());
+    x[i] = (double)(k * pio2);
+  }
+}
+
+// Расстояние между a и b в числах double.
+static uint64_t ulp_distance(double a, double b) {
+  int64_t ia, ib;
+  memcpy(&ia, &a, sizeof ia);
+  memcpy(&ib, &b, sizeof ib);
+  if (ia < 0)
+    ia = INT64_MIN - ia;
+  if (ib < 0)
+    ib = INT64_MIN - ib;
+  return ia > ib ? (uint64_t)ia - ib : (uint64_t)ib - ia;
+}
+
+static double seconds(void) {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char** argv) {
+  size_t n = argc > 1 ? strtoul(argv[1], NULL, 10) : 1u << 22;
+  if (n == 0) {
+    fprintf(stderr, "Недопустимое значение размера.\n");
+    exit(EXIT_FAILURE);
+  }
+  double* x = malloc(n * sizeof(double));
+  double* expected = malloc(n * sizeof(double));
+  double* actual = malloc(n * sizeof(double));
+  if (!x || !expected || !actual) {
+    perror("Ошибка выделения памяти для массива\n");
+    exit(EXIT_FAILURE);
+  }
+  // Страницы выделяются до замеров, а не в первом из них
+  memset(expected, 0, n * sizeof(double));
+  memset(actual, 0, n * sizeof(double));
+
+  const argument_set sets[] = {
+      {"2*(10i+j)", fill_doubled},     {"3*(10i+j)", fill_tripled},
+      {"3*sin(...)", fill_tripled_sin}, {"0.04*(10i+j)", fill_scaled},
+      {"вся область", fill_random},     {"около k*pi/2", fill_near_pio2},
+      {"граница", fill_boundary},
+  };
+#ifdef VSIN_FAST
+  printf("Режим: быстрый (VSIN_FAST), %zu аргументов в наборе\n", n);
+#else
+  printf("Режим: строгий, %zu аргументов в наборе\n", n);
+#endif
+  printf("макс. ulp    > 1 ulp   libm, нс   vsin, нс  набор\n");
+
+  uint64_t worst = 0;
+  for (size_t s = 0; s < sizeof sets / sizeof sets[0]; s++) {
+    sets[s].fill(x, n);
+
+    double start = seconds();
+    for (size_t i = 0; i < n; i++)
+      expected[i] = sin(x[i]);
+    double libm_time = seconds() - start;
+
+    start = seconds();
+#pragma omp simd
+    for (size_t i = 0; i < n; i++)
+      actual[i] = vsin(x[i]);
+    double vsin_time = seconds() - start;
+
+    uint64_t max_ulp = 0;
+    size_t over = 0;
+    for (size_t i = 0; i < n; i++) {
+      uint64_t d = ulp_distance(expected[i], actual[i]);
+      if (d > max_ulp)
+        max_ulp = d;
+      if (d > 1)
+        over++;
+    }
+    if (max_ulp > worst)
+      worst = max_ulp;
+    printf("%9llu %10zu %10.2f %10.2f  %s\n", (unsigned long long)max_ulp,
+           over, libm_time / n * 1e9, vsin_time / n * 1e9, sets[s].name);
+  }
+
+  free(x);
+  free(expected);
+  free(actual);
+#ifndef VSIN_FAST
+  if (worst > 1) {
+    fprintf(stderr, "Ошибка больше 1 ulp\n");
+    return EXIT_FAILURE;
+  }
+#endif
+  return 0;
+}
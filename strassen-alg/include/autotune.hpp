@@ -0,0 +1,270 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "executor.hpp"
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
+
+// Start-up tuning of the recursion for the machine it runs on.
+//
+// autotune() measures, on the current CPU, the blocked leaf kernel under a
+// few tile shapes, one Strassen step against the kernel at growing sizes to
+// find the crossover, and a full multiply with more and more task levels to
+// find where the parallelism stops paying for the spawn and wait cost. The
+// result is kept in a small text file, one line per CPU model, thread count
+// and element type, which later runs load at start-up.
+
+// The measured parameters; the rest of strassen_params stays as given.
+struct tuning {
+  std::size_t leaf = 64;
+  unsigned task_depth = 3;
+  gemm_tiles tiles;
+
+  // The tiles always; the leaf and the task depth unless the caller keeps
+  // values given on its command line.
+  void applyTo(strassen_params& params, bool keep_leaf = false,
+               bool keep_task_depth = false) const {
+    if (!keep_leaf)
+      params.leaf = leaf;
+    if (!keep_task_depth)
+      params.task_depth = task_depth;
+    params.tiles = tiles;
+  }
+};
+
+// "model name" of /proc/cpuinfo, or "unknown" where there is none.
+inline std::string cpuModel() {
+  std::ifstream cpuinfo{"/proc/cpuinfo"};
+  std::string line;
+  while (std::getline(cpuinfo, line)) {
+    if (line.rfind("model name", 0) != 0)
+      continue;
+    auto colon = line.find(':');
+    if (colon == std::string::npos)
+      break;
+    auto first = line.find_first_not_of(" \t", colon + 1);
+    return first == std::string::npos ? "unknown" : line.substr(first);
+  }
+  return "unknown";
+}
+
+// Key of a tuning in the cache file. Fields are separated by tabs, which a
+// CPU model name never contains.
+inline std::string tuningKey(unsigned threads, const std::string& type) {
+  return cpuModel() + '\t' + std::to_string(threads) + '\t' + type;
+}
+
+// $STRASSEN_TUNE_FILE, else strassen/tuning under the XDG cache directory.
+inline std::string defaultTuningFile() {
+  if (const char* file = std::getenv("STRASSEN_TUNE_FILE"))
+    return file;
+  std::filesystem::path dir;
+  if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache)
+    dir = cache;
+  else if (const char* home = std::getenv("HOME"))
+    dir = std::filesystem::path{home} / ".cache";
+  else
+    dir = std::filesystem::temp_directory_path();
+  return dir / "strassen" / "tuning";
+}
+
+// Lines of the cache file: key, then leaf, task depth, mc, kc and nc.
+inline std::optional<tuning> loadTuning(const std::string& path,
+                                        const std::string& key) {
+  std::ifstream is{path};
+  std::string line;
+  while (std::getline(is, line)) {
+    auto end = line.rfind('\t');
+    if (end == std::string::npos || line.compare(0, end, key) != 0)
+      continue;
+    std::istringstream values{line.substr(end + 1)};
+    tuning t;
+    if (values >> t.leaf >> t.task_depth >> t.tiles.mc >> t.tiles.kc >>
+            t.tiles.nc &&
+        t.leaf > 0 && t.tiles.mc > 0 && t.tiles.kc > 0 && t.tiles.nc > 0)
+      return t;
+  }
+  return std::nullopt;
+}
+
+// Stores t under key, replacing an older entry with the same key.
+inline void saveTuning(const std::string& path, const std::string& key,
+                       const tuning& t) {
+  std::vector<std::string> lines;
+  {
+    std::ifstream is{path};
+    std::string line;
+    while (std::getline(is, line)) {
+      auto end = line.rfind('\t');
+      if (end == std::string::npos || line.compare(0, end, key) != 0)
+        lines.push_back(line);
+    }
+  }
+  std::ostringstream entry;
+  entry << key << '\t' << t.leaf << ' ' << t.task_depth << ' ' << t.tiles.mc
+        << ' ' << t.tiles.kc << ' ' << t.tiles.nc;
+  lines.push_back(entry.str());
+
+  auto dir = std::filesystem::path{path}.parent_path();
+  if (!dir.empty())
+    std::filesystem::create_directories(dir);
+  std::ofstream os{path, std::ios::trunc};
+  for (const auto& line : lines)
+    os << line << '\n';
+  if (!os)
+    throw std::runtime_error("Cannot write " + path);
+}
+
+namespace detail {
+
+// Fastest of a few runs of f, in seconds.
+template <typename F>
+double bestTime(F&& f, int runs = 3) {
+  double best = 0;
+  for (int run = 0; run < runs; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    best = run == 0 ? elapsed.count() : std::min(best, elapsed.count());
+  }
+  return best;
+}
+
+template <typename T>
+matrix<T> tuningOperand(std::size_t rows, std::size_t cols) {
+  matrix<T> M{rows, cols, uninitialized};
+  for (std::size_t i = 0; i < rows; ++i)
+    for (std::size_t j = 0; j < cols; ++j)
+      M[i][j] = T((i * 7 + j * 3) % 5);
+  return M;
+}
+
+// A full multiply on the executor the run will use: the pool if there is
+// one, else an OpenMP parallel region of threads threads.
+template <typename T>
+void tunedMultiply(const matrix<T>& A, const matrix<T>& B, matrix<T>& C,
+                   workspace& ws, const strassen_params& params,
+                   [[maybe_unused]] unsigned threads) {
+  if (params.pool) {
+    params.pool->run([&] {
+      algorithmStrassen(A.view(), B.view(), C.view(), ws, params);
+    });
+    return;
+  }
+#pragma omp parallel num_threads(threads)
+{
+  #pragma omp single
+    algorithmStrassen(A.view(), B.view(), C.view(), ws, params);
+}
+}
+
+}  // namespace detail
+
+// Measures the tiles, the leaf size and the task depth for elements of type
+// T, in that order, each with the best of the ones before. params supplies
+// the formula, the layout and the executor (params.pool, or threads OpenMP
+// threads); its tunables are the fallback if no candidate can be measured.
+template <typename T>
+tuning autotune(const strassen_params& params, unsigned threads) {
+  using detail::bestTime;
+  tuning best{params.leaf, params.task_depth, params.tiles};
+
+  // Tiles: the leaf kernel alone, on operands several tiles deep and wide;
+  // first the kc x nc panel of B, then the rows of A that stream through it.
+  {
+    constexpr std::size_t size = 512;
+    auto A = detail::tuningOperand<T>(size, size);
+    auto B = detail::tuningOperand<T>(size, size);
+    matrix<T> C{size, size, uninitialized};
+    double best_time = 0;
+    for (std::size_t kc : {128, 256, 384, 512})
+      for (std::size_t nc : {256, 512, 1024}) {
+        gemm_tiles tiles{best.tiles.mc, kc, nc};
+        double t = bestTime(
+            [&] { multiplyBlocked(C.view(), A.view(), B.view(), tiles); });
+        if (best_time == 0 || t < best_time) {
+          best_time = t;
+          best.tiles = tiles;
+        }
+      }
+    for (std::size_t mc : {32, 64, 128, 256}) {
+      gemm_tiles tiles{mc, best.tiles.kc, best.tiles.nc};
+      double t = bestTime(
+          [&] { multiplyBlocked(C.view(), A.view(), B.view(), tiles); });
+      if (t < best_time) {
+        best_time = t;
+        best.tiles = tiles;
+      }
+    }
+  }
+
+  // Leaf: the smallest s for which one Strassen step on 2s x 2s, down to
+  // seven kernel calls on s x s, beats the kernel on the whole product.
+  {
+    strassen_params step = params;
+    step.tiles = best.tiles;
+    step.task_depth = 0;
+    step.pool = nullptr;
+    std::size_t leaf = 0;
+    for (std::size_t s : {16, 32, 64, 128, 256, 512}) {
+      auto A = detail::tuningOperand<T>(2 * s, 2 * s);
+      auto B = detail::tuningOperand<T>(2 * s, 2 * s);
+      matrix<T> C{2 * s, 2 * s, uninitialized};
+      step.leaf = s;
+      workspace ws{strassenScratch<T>(2 * s, 2 * s, 2 * s, step), 1};
+      double kernel = bestTime(
+          [&] { multiplyBlocked(C.view(), A.view(), B.view(), best.tiles); });
+      double strassen = bestTime(
+          [&] { algorithmStrassen(A.view(), B.view(), C.view(), ws, step); });
+      if (strassen < kernel) {
+        leaf = s;
+        break;
+      }
+    }
+    best.leaf = leaf ? leaf : 1024;
+  }
+
+  // Task depth: a multiply several levels deep on the run's executor; a
+  // level more only pays off if its tasks beat the cost of spawning them.
+  // One thread has nothing to gain from tasks.
+  unsigned workers = params.pool ? params.pool->size() : threads;
+  if (workers == 1) {
+    best.task_depth = 0;
+  } else {
+    std::size_t size = std::min<std::size_t>(best.leaf * 16, 2048);
+    auto A = detail::tuningOperand<T>(size, size);
+    auto B = detail::tuningOperand<T>(size, size);
+    matrix<T> C{size, size, uninitialized};
+    strassen_params run = params;
+    run.leaf = best.leaf;
+    run.tiles = best.tiles;
+    double best_time = 0;
+    for (unsigned depth = 0; depth <= 4; ++depth) {
+      run.task_depth = depth;
+      workspace ws{strassenScratch<T>(size, size, size, run), workers};
+      double t = bestTime(
+          [&] { detail::tunedMultiply(A, B, C, ws, run, threads); }, 2);
+      // Deeper only for a clear gain: the spawn cost grows with the
+      // number of tasks, the measurement noise does not.
+      if (best_time == 0 || t < 0.97 * best_time) {
+        best_time = t;
+        best.task_depth = depth;
+      }
+    }
+  }
+
+  return best;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+
+// Batches of independent small products, C_i = A_i * B_i, for workloads of
+// many 16 x 16 .. 128 x 128 matrices where a matrix object per operand and a
+// recursion per product would cost more than the arithmetic.
+//
+// A batch is a view over caller-owned memory: count matrices of one shape,
+// item i starting at data() + i * itemStride(). The items are spread over the
+// threads of an OpenMP parallel region; each one runs a kernel whose shape is
+// a template argument, so every loop bound is a constant and the accumulators
+// stay in registers.
+template <typename T>
+class basic_matrix_batch {
+  T* ptr = nullptr;
+  std::size_t items = 0;
+  std::size_t rows = 0;
+  std::size_t cols = 0;
+  std::size_t row_stride = 0;
+  std::size_t item_stride = 0;
+
+ public:
+  using value_type = std::remove_const_t<T>;
+
+  basic_matrix_batch() = default;
+
+  // Densely packed items.
+  basic_matrix_batch(T* ptr, std::size_t count, std::size_t rows,
+                     std::size_t cols)
+      : basic_matrix_batch{ptr, count, rows, cols, cols, rows * cols} {}
+
+  basic_matrix_batch(T* ptr, std::size_t count, std::size_t rows,
+                     std::size_t cols, std::size_t stride,
+                     std::size_t item_stride)
+      : ptr{ptr}, items{count}, rows{rows}, cols{cols}, row_stride{stride},
+        item_stride{item_stride} {}
+
+  template <typename U>
+    requires std::is_convertible_v<U (*)[], T (*)[]>
+  basic_matrix_batch(const basic_matrix_batch<U>& rhs)
+      : ptr{rhs.data()}, items{rhs.count()}, rows{rhs.nrows()},
+        cols{rhs.ncols()}, row_stride{rhs.stride()},
+        item_stride{rhs.itemStride()} {}
+
+  basic_matrix_view<T> operator[](std::size_t idx) const {
+    return basic_matrix_view<T>{ptr + idx * item_stride, rows, cols,
+                                row_stride};
+  }
+
+  T* data() const { return ptr; }
+  std::size_t count() const { return items; }
+  std::size_t nrows() const { return rows; }
+  std::size_t ncols() const { return cols; }
+  std::size_t stride() const { return row_stride; }
+  std::size_t itemStride() const { return item_stride; }
+};
+
+template <typename T>
+using matrix_batch = basic_matrix_batch<T>;
+
+template <typename T>
+using const_matrix_batch = std::type_identity_t<basic_matrix_batch<const T>>;
+
+namespace detail {
+
+// C[0:MR][0:NB] = A[0:MR][0:K] * B[0:K][0:NB] with every bound known at
+// compile time. B is read in place: at these sizes its rows are already in L1
+// or L2, so packing it would only add a copy per product.
+template <std::size_t MR, std::size_t NB, std::size_t K, typename T>
+void fixedBlock(T* C, std::size_t ldc, const T* A, std::size_t lda,
+                const T* B, std::size_t ldb) {
+  using W = kernel_t<T>;
+  W acc[MR][NB] = {};
+  for (std::size_t k = 0; k < K; ++k) {
+    const T* b = B + k * ldb;
+    for (std::size_t r = 0; r < MR; ++r) {
+      W a = A[r * lda + k];
+#pragma omp simd
+      for (std::size_t c = 0; c < NB; ++c)
+        acc[r][c] += a * W(b[c]);
+    }
+  }
+  for (std::size_t r = 0; r < MR; ++r) {
+#pragma omp simd
+    for (std::size_t c = 0; c < NB; ++c)
+      C[r * ldc + c] = T(acc[r][c]);
+  }
+}
+
+// The columns of one band of MR rows in blocks of NB, then the remainder.
+template <std::size_t MR, std::size_t K, std::size_t N, typename T>
+void fixedRows(T* C, std::size_t ldc, const T* A, std::size_t lda,
+               const T* B, std::size_t ldb) {
+  constexpr std::size_t NB = std::min(N, 2 * kernel_nr<T>);
+  for (std::size_t j = 0; j + NB <= N; j += NB)
+    fixedBlock<MR, NB, K>(C + j, ldc, A, lda, B + j, ldb);
+  if constexpr (N % NB != 0)
+    fixedBlock<MR, N % NB, K>(C + N / NB * NB, ldc, A, lda, B + N / NB * NB,
+                              ldb);
+}
+
+}  // namespace detail
+
+// C = A * B for an M x K by K x N product whose shape is fixed at compile
+// time.
+template <std::size_t M, std::size_t K, std::size_t N, typename T>
+void multiplyFixed(matrix_view<T> C, const_matrix_view<T> A,
+                   const_matrix_view<T> B) {
+  constexpr std::size_t MR = std::min(M, detail::kernel_mr);
+  for (std::size_t i = 0; i + MR <= M; i += MR)
+    detail::fixedRows<MR, K, N>(C[i], C.stride(), A[i], A.stride(), B[0],
+                                B.stride());
+  if constexpr (M % MR != 0)
+    detail::fixedRows<M % MR, K, N>(C[M / MR * MR], C.stride(),
+                                    A[M / MR * MR], A.stride(), B[0],
+                                    B.stride());
+}
+
+template <typename T>
+void checkBatchShapes(const basic_matrix_batch<T>& C,
+                      const const_matrix_batch<std::remove_const_t<T>>& A,
+                      const const_matrix_batch<std::remove_const_t<T>>& B) {
+  if (A.count() != C.count() || B.count() != C.count() ||
+      A.ncols() != B.nrows() || A.nrows() != C.nrows() ||
+      B.ncols() != C.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+}
+
+// C_i = A_i * B_i for a batch of shape M x K by K x N fixed at compile time.
+template <std::size_t M, std::size_t K, std::size_t N, typename T>
+void multiplyBatched(matrix_batch<T> C, const_matrix_batch<T> A,
+                     const_matrix_batch<T> B) {
+  if (A.nrows() != M || A.ncols() != K || B.ncols() != N)
+    throw std::runtime_error("Unsuitable matrix sizes");
+  checkBatchShapes(C, A, B);
+
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < C.count(); ++i)
+    multiplyFixed<M, K, N>(C[i], A[i], B[i]);
+}
+
+// Square sizes with a compiled kernel for the batches whose shape is known
+// only at run time.
+inline constexpr std::size_t batched_sizes[] = {8,  16, 24, 32,
+                                                48, 64, 96, 128};
+
+namespace detail {
+
+template <typename T>
+using small_kernel = void (*)(matrix_view<T>, const_matrix_view<T>,
+                              const_matrix_view<T>);
+
+// The compiled kernel of an m x k by k x n product, or the blocked leaf
+// kernel of the Strassen recursion for shapes without one.
+template <typename T, std::size_t... I>
+small_kernel<T> smallKernel(std::size_t m, std::size_t k, std::size_t n,
+                            std::index_sequence<I...>) {
+  small_kernel<T> kernel = [](matrix_view<T> C, const_matrix_view<T> A,
+                              const_matrix_view<T> B) {
+    multiplyBlocked(C, A, B);
+  };
+  if (m == k && k == n)
+    ((n == batched_sizes[I] &&
+      (kernel = &multiplyFixed<batched_sizes[I], batched_sizes[I],
+                               batched_sizes[I], T>,
+       true)) ||
+     ...);
+  return kernel;
+}
+
+template <typename T>
+small_kernel<T> smallKernel(std::size_t m, std::size_t k, std::size_t n) {
+  return smallKernel<T>(m, k, n,
+                        std::make_index_sequence<std::size(batched_sizes)>{});
+}
+
+}  // namespace detail
+
+// C_i = A_i * B_i for a batch whose shape is known at run time.
+template <typename T>
+void multiplyBatched(matrix_batch<T> C, const_matrix_batch<T> A,
+                     const_matrix_batch<T> B) {
+  checkBatchShapes(C, A, B);
+  auto kernel = detail::smallKernel<T>(A.nrows(), A.ncols(), B.ncols());
+
+#pragma omp parallel for schedule(static)
+  for (std::size_t i = 0; i < C.count(); ++i)
+    kernel(C[i], A[i], B[i]);
+}
+
+// One shape of a grouped batch.
+template <typename T>
+struct batch_group {
+  matrix_batch<T> C;
+  const_matrix_batch<T> A;
+  const_matrix_batch<T> B;
+};
+
+// Batches of different shapes in one parallel region. Items are uniform
+// within a group, so each group is split statically and the threads move on
+// to the next group without waiting for each other.
+template <typename T>
+void multiplyGrouped(const std::vector<batch_group<T>>& groups) {
+  std::vector<detail::small_kernel<T>> kernels;
+  for (const auto& g : groups) {
+    checkBatchShapes(g.C, g.A, g.B);
+    kernels.push_back(
+        detail::smallKernel<T>(g.A.nrows(), g.A.ncols(), g.B.ncols()));
+  }
+
+#pragma omp parallel
+  {
+    for (std::size_t group = 0; group < groups.size(); ++group) {
+      const auto& g = groups[group];
+      #pragma omp for schedule(static) nowait
+      for (std::size_t i = 0; i < g.C.count(); ++i)
+        kernels[group](g.C[i], g.A[i], g.B[i]);
+    }
+  }
+}
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
+
+// Products of several matrices, A_0 * A_1 * ... * A_{n-1}, and powers A^e,
+// on top of algorithmStrassen.
+//
+// A chain is evaluated in the order that minimizes the multiply-adds of the
+// classic products, found by the textbook dynamic program over the
+// dimensions. The two operands of a product are independent sub-chains and
+// run as OpenMP tasks of their own; every product inside them runs the
+// parallel recursion as usual. Intermediate results live in buffers that are
+// handed back as soon as the product consuming them is done, so later
+// products reuse them instead of allocating.
+//
+// Like algorithmStrassen, call these from one thread of a parallel region
+// (or a thread_pool::run through params.pool, where the sub-chains then run
+// one after the other).
+
+// Evaluation order of a chain with factor i of size dims[i] x dims[i + 1].
+class chain_plan {
+  std::size_t count = 0;
+  std::vector<std::size_t> dim;
+  // Last factor of the left operand of the product of factors i..j.
+  std::vector<std::size_t> splits;
+  std::size_t total = 0;
+
+ public:
+  chain_plan() = default;
+
+  explicit chain_plan(std::vector<std::size_t> dims)
+      : count{dims.size() - 1}, dim{std::move(dims)} {
+    if (dim.size() < 2)
+      throw std::runtime_error("Empty matrix chain");
+
+    // cost[i][j]: multiply-adds of the best order of factors i..j.
+    std::vector<std::size_t> cost(count * count, 0);
+    splits.assign(count * count, 0);
+    for (std::size_t len = 2; len <= count; ++len) {
+      for (std::size_t i = 0; i + len <= count; ++i) {
+        std::size_t j = i + len - 1;
+        std::size_t best = std::numeric_limits<std::size_t>::max();
+        for (std::size_t s = i; s < j; ++s) {
+          std::size_t c = cost[i * count + s] + cost[(s + 1) * count + j] +
+                          dim[i] * dim[s + 1] * dim[j + 1];
+          if (c < best) {
+            best = c;
+            splits[i * count + j] = s;
+          }
+        }
+        cost[i * count + j] = best;
+      }
+    }
+    total = cost[count - 1];
+  }
+
+  std::size_t factors() const { return count; }
+  std::size_t rows(std::size_t i) const { return dim[i]; }
+  std::size_t cols(std::size_t i) const { return dim[i + 1]; }
+  std::size_t split(std::size_t i, std::size_t j) const {
+    return splits[i * count + j];
+  }
+  // Multiply-adds of the classic products in this order.
+  std::size_t cost() const { return total; }
+};
+
+template <typename T>
+chain_plan planChain(const std::vector<basic_matrix_view<const T>>& factors) {
+  if (factors.empty())
+    throw std::runtime_error("Empty matrix chain");
+  std::vector<std::size_t> dims{factors.front().nrows()};
+  for (const auto& f : factors) {
+    if (f.nrows() != dims.back())
+      throw std::runtime_error("Unsuitable matrix sizes");
+    dims.push_back(f.ncols());
+  }
+  return chain_plan{std::move(dims)};
+}
+
+// Arena size per thread for evaluating plan: the largest of its products.
+template <typename T>
+std::size_t chainScratch(const chain_plan& plan,
+                         const strassen_params& params) {
+  std::size_t bytes = 0;
+  auto visit = [&](auto& self, std::size_t i, std::size_t j) -> void {
+    if (i == j)
+      return;
+    std::size_t s = plan.split(i, j);
+    bytes = std::max(bytes, strassenScratch<T>(plan.rows(i), plan.cols(s),
+                                               plan.cols(j), params));
+    self(self, i, s);
+    self(self, s + 1, j);
+  };
+  visit(visit, 0, plan.factors() - 1);
+  return bytes;
+}
+
+namespace detail {
+
+// Storage of intermediate results, recycled between the products of one
+// chain. Shared by its tasks, hence the lock.
+template <typename T>
+class chain_buffers {
+ public:
+  using buffer = std::vector<T, default_init_allocator<T>>;
+
+  // The smallest free buffer that fits size elements, else a new one.
+  buffer take(std::size_t size) {
+    std::lock_guard lock{mutex};
+    auto fit = free.end();
+    for (auto it = free.begin(); it != free.end(); ++it)
+      if (it->capacity() >= size &&
+          (fit == free.end() || it->capacity() < fit->capacity()))
+        fit = it;
+    if (fit == free.end())
+      return buffer(size);
+    buffer b = std::move(*fit);
+    free.erase(fit);
+    b.resize(size);
+    return b;
+  }
+
+  void give(buffer b) {
+    if (b.capacity() == 0)
+      return;
+    std::lock_guard lock{mutex};
+    free.push_back(std::move(b));
+  }
+
+ private:
+  std::mutex mutex;
+  std::vector<buffer> free;
+};
+
+template <typename T>
+class chain_evaluator {
+  using buffer = typename chain_buffers<T>::buffer;
+
+  // A factor in place, or a product in a buffer of the pool.
+  struct value {
+    buffer storage;
+    const_matrix_view<T> view;
+  };
+
+  const std::vector<const_matrix_view<T>>& factors;
+  const chain_plan& plan;
+  workspace& ws;
+  const strassen_params& params;
+  chain_buffers<T> buffers;
+
+  value evaluate(std::size_t i, std::size_t j) {
+    if (i == j)
+      return {{}, factors[i]};
+    buffer out = buffers.take(plan.rows(i) * plan.cols(j));
+    matrix_view<T> C{out.data(), plan.rows(i), plan.cols(j), plan.cols(j)};
+    evaluateInto(i, j, C);
+    return {std::move(out), C};
+  }
+
+ public:
+  chain_evaluator(const std::vector<const_matrix_view<T>>& factors,
+                  const chain_plan& plan, workspace& ws,
+                  const strassen_params& params)
+      : factors{factors}, plan{plan}, ws{ws}, params{params} {}
+
+  // C = factors[i] * ... * factors[j] for i < j.
+  void evaluateInto(std::size_t i, std::size_t j, matrix_view<T> C) {
+    std::size_t s = plan.split(i, j);
+    value left, right;
+    // Both operands are products: compute them side by side.
+    [[maybe_unused]] bool both = i < s && s + 1 < j && !params.pool;
+    #pragma omp task shared(left) if (both)
+    left = evaluate(i, s);
+    #pragma omp task shared(right) if (both)
+    right = evaluate(s + 1, j);
+    #pragma omp taskwait
+
+    algorithmStrassen(left.view, right.view, C, ws, params);
+    buffers.give(std::move(left.storage));
+    buffers.give(std::move(right.storage));
+  }
+};
+
+}  // namespace detail
+
+// factors[0] * factors[1] * ... in the order of plan, into C. ws needs
+// chainScratch(plan) bytes per thread.
+template <typename T>
+void multiplyChain(const std::vector<basic_matrix_view<const T>>& factors,
+                   matrix_view<T> C, const chain_plan& plan, workspace& ws,
+                   const strassen_params& params) {
+  if (factors.size() != plan.factors() || C.nrows() != plan.rows(0) ||
+      C.ncols() != plan.cols(plan.factors() - 1))
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  if (factors.size() == 1) {
+    for (std::size_t i = 0; i < C.nrows(); ++i)
+      std::copy(factors[0][i], factors[0][i] + C.ncols(), C[i]);
+    return;
+  }
+  detail::chain_evaluator<T>{factors, plan, ws, params}.evaluateInto(
+      0, factors.size() - 1, C);
+}
+
+template <typename T>
+matrix<T> multiplyChain(const std::vector<basic_matrix_view<const T>>& factors,
+                        workspace& ws, const strassen_params& params) {
+  auto plan = planChain(factors);
+  matrix<T> C{plan.rows(0), plan.cols(plan.factors() - 1), uninitialized};
+  multiplyChain(factors, C.view(), plan, ws, params);
+  return C;
+}
+
+// A^e for a square A by left-to-right square-and-multiply: one squaring per
+// bit of e below the leading one and one multiply by A per set bit, between
+// two buffers that trade places after every product. ws needs
+// strassenScratch(n, n, n) bytes per thread.
+template <typename T>
+matrix<T> pow(basic_matrix_view<const T> A, unsigned long long e,
+              workspace& ws, const strassen_params& params) {
+  std::size_t n = A.nrows();
+  if (A.ncols() != n)
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  matrix<T> result{n, n, uninitialized};
+  if (e == 0) {
+    for (std::size_t i = 0; i < n; ++i) {
+      std::fill(result[i].begin(), result[i].end(), T{});
+      result[i][i] = T{1};
+    }
+    return result;
+  }
+
+  matrix<T> next{n, n, uninitialized};
+  for (std::size_t i = 0; i < n; ++i)
+    std::copy(A[i], A[i] + n, result[i].begin());
+  int bit = std::numeric_limits<unsigned long long>::digits - 1;
+  while (!(e >> bit & 1))
+    --bit;
+  for (--bit; bit >= 0; --bit) {
+    algorithmStrassen(result.view(), result.view(), next.view(), ws, params);
+    std::swap(result, next);
+    if (e >> bit & 1) {
+      algorithmStrassen(result.view(), A, next.view(), ws, params);
+      std::swap(result, next);
+    }
+  }
+  return result;
+}
+
+template <typename T>
+matrix<T> pow(const matrix<T>& A, unsigned long long e, workspace& ws,
+              const strassen_params& params) {
+  return pow(A.view(), e, ws, params);
+}
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// Work-stealing executor for the task levels of the Strassen recursion, an
+// alternative to the OpenMP task runtime.
+//
+// Every worker owns a Chase-Lev deque: it pushes and pops the tasks it spawns
+// at the bottom, idle workers steal the oldest, largest tasks from the top.
+// Tasks are tied to a recursion depth. A worker waiting for the tasks of a
+// level at depth d runs only tasks spawned at depth d or deeper meanwhile, so
+// the frames it takes from its arena still form one root-to-leaf chain with
+// at most one node per level, the bound workspace sizes the arenas for.
+
+class thread_pool;
+class task_group;
+
+namespace detail {
+
+struct pool_job {
+  std::function<void()> fn;
+  task_group* group;
+  unsigned depth;
+};
+
+// Fixed-capacity Chase-Lev deque (Chase and Lev, 2005, with the memory orders
+// of Le et al., 2013). A slot is not reused before its job has left the
+// deque, so a thief may read the depth of the job at the top before it claims
+// the job.
+class job_deque {
+  static constexpr std::int64_t capacity = 1 << 12;
+  static constexpr std::int64_t mask = capacity - 1;
+
+  struct slot {
+    std::atomic<pool_job*> job{nullptr};
+    std::atomic<unsigned> depth{0};
+  };
+
+  alignas(64) std::atomic<std::int64_t> top{0};
+  alignas(64) std::atomic<std::int64_t> bottom{0};
+  std::unique_ptr<slot[]> slots{new slot[capacity]};
+
+ public:
+  // Owner only. Fails when the deque is full.
+  bool push(pool_job* job) {
+    std::int64_t b = bottom.load(std::memory_order_relaxed);
+    std::int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= capacity)
+      return false;
+    slots[b & mask].job.store(job, std::memory_order_relaxed);
+    slots[b & mask].depth.store(job->depth, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Owner only: the newest job, or nullptr.
+  pool_job* pop() {
+    std::int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    pool_job* job = slots[b & mask].job.load(std::memory_order_relaxed);
+    if (t == b) {
+      // Last job: race the thieves for it.
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed))
+        job = nullptr;
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  // Any thread: the oldest job if it was spawned at min_depth or deeper.
+  pool_job* steal(unsigned min_depth) {
+    std::int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    std::int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b)
+      return nullptr;
+    if (slots[t & mask].depth.load(std::memory_order_relaxed) < min_depth)
+      return nullptr;
+    pool_job* job = slots[t & mask].job.load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed))
+      return nullptr;
+    return job;
+  }
+};
+
+}  // namespace detail
+
+class thread_pool {
+  friend class task_group;
+
+  inline static thread_local int worker_index = -1;
+
+  std::vector<std::unique_ptr<detail::job_deque>> deques;
+  std::vector<std::thread> threads;
+  std::vector<int> cpus;
+  bool pin;
+
+  std::mutex mutex;
+  std::condition_variable wake;
+  bool stopping = false;
+  std::atomic<bool> active{false};
+  // Broadcast of forEachWorker(): a new generation runs broadcast_fn once on
+  // every worker.
+  std::uint64_t generation = 0;
+  std::function<void(unsigned)> broadcast_fn;
+  std::atomic<unsigned> broadcast_done{0};
+
+  static void pinTo(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)cpu;
+#endif
+  }
+
+  void execute(detail::pool_job* job);
+
+  // A job for worker `self` to run: its own newest job, else one stolen from
+  // another worker; only jobs spawned at min_depth or deeper.
+  detail::pool_job* findWork(unsigned self, unsigned min_depth) {
+    auto& own = *deques[self];
+    if (detail::pool_job* job = own.pop()) {
+      if (job->depth >= min_depth)
+        return job;
+      own.push(job);
+    }
+    for (std::size_t i = 1; i < deques.size(); ++i) {
+      auto& victim = *deques[(self + i) % deques.size()];
+      if (detail::pool_job* job = victim.steal(min_depth))
+        return job;
+    }
+    return nullptr;
+  }
+
+  void workerLoop(unsigned self) {
+    worker_index = static_cast<int>(self);
+    if (pin)
+      pinTo(cpus[self % cpus.size()]);
+
+    std::uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock lock{mutex};
+        wake.wait(lock,
+                  [&] { return stopping || active || generation != seen; });
+        if (stopping)
+          return;
+        if (generation != seen) {
+          seen = generation;
+          lock.unlock();
+          broadcast_fn(self);
+          broadcast_done.fetch_add(1, std::memory_order_release);
+          continue;
+        }
+      }
+      while (active.load(std::memory_order_acquire)) {
+        if (detail::pool_job* job = findWork(self, 0))
+          execute(job);
+        else
+          std::this_thread::yield();
+      }
+    }
+  }
+
+ public:
+  // threads workers in total, one of which is the thread calling run(). With
+  // pin, worker i is bound to the i-th CPU the process may run on.
+  explicit thread_pool(unsigned threads, bool pin = false) : pin{pin} {
+    threads = std::max(threads, 1u);
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &allowed))
+          cpus.push_back(cpu);
+    }
+#endif
+    if (cpus.empty())
+      this->pin = false;
+
+    for (unsigned i = 0; i < threads; ++i)
+      deques.push_back(std::make_unique<detail::job_deque>());
+    for (unsigned i = 1; i < threads; ++i)
+      this->threads.emplace_back([this, i] { workerLoop(i); });
+  }
+
+  thread_pool(const thread_pool&) = delete;
+  thread_pool& operator=(const thread_pool&) = delete;
+
+  ~thread_pool() {
+    {
+      std::lock_guard lock{mutex};
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto& t : threads)
+      t.join();
+  }
+
+  unsigned size() const { return static_cast<unsigned>(deques.size()); }
+
+  // Index of the calling thread in the pool it is working for, or -1.
+  static int currentWorker() { return worker_index; }
+
+  // Runs f on the calling thread as worker 0 while the other workers steal
+  // the tasks it spawns. f must wait for everything it spawns.
+  template <typename F>
+  void run(F&& f) {
+    assert(worker_index < 0 && "run() does not nest");
+#ifdef __linux__
+    cpu_set_t saved;
+    bool restore = pin && pthread_getaffinity_np(pthread_self(), sizeof(saved),
+                                                 &saved) == 0;
+    if (pin)
+      pinTo(cpus[0]);
+#endif
+    worker_index = 0;
+    {
+      std::lock_guard lock{mutex};
+      active = true;
+    }
+    wake.notify_all();
+
+    struct deactivate {
+      thread_pool& pool;
+      ~deactivate() {
+        pool.active = false;
+        worker_index = -1;
+      }
+    } guard{*this};
+    f();
+
+#ifdef __linux__
+    if (restore)
+      pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+#endif
+  }
+
+  // Calls f(worker) once on every worker thread, worker 0 being the caller,
+  // and returns when all calls are done. Used to first-touch memory from the
+  // thread that will work on it.
+  void forEachWorker(std::function<void(unsigned)> f) {
+    {
+      std::lock_guard lock{mutex};
+      broadcast_fn = std::move(f);
+      broadcast_done = 0;
+      ++generation;
+    }
+    wake.notify_all();
+    broadcast_fn(0);
+    while (broadcast_done.load(std::memory_order_acquire) + 1 < size())
+      std::this_thread::yield();
+  }
+};
+
+// Tasks spawned by one step of the recursion, waited for together.
+class task_group {
+  thread_pool& pool;
+  std::atomic<std::size_t> pending{0};
+
+  friend class thread_pool;
+
+ public:
+  explicit task_group(thread_pool& pool) : pool{pool} {}
+  task_group(const task_group&) = delete;
+  task_group& operator=(const task_group&) = delete;
+  ~task_group() { assert(pending == 0); }
+
+  // Spawns f as a task of recursion depth `depth`. Outside a worker, or with
+  // a full deque, f runs right away.
+  template <typename F>
+  void spawn(unsigned depth, F&& f) {
+    int self = thread_pool::currentWorker();
+    pending.fetch_add(1, std::memory_order_relaxed);
+    auto* job = new detail::pool_job{std::forward<F>(f), this, depth};
+    if (self < 0 || !pool.deques[self]->push(job))
+      pool.execute(job);
+  }
+
+  // Waits for the spawned tasks. Meanwhile the worker runs tasks spawned at
+  // `depth` or deeper, which include the group's own.
+  void wait(unsigned depth) {
+    int self = thread_pool::currentWorker();
+    while (pending.load(std::memory_order_acquire) != 0) {
+      detail::pool_job* job =
+          self < 0 ? nullptr : pool.findWork(self, depth);
+      if (job)
+        pool.execute(job);
+      else
+        std::this_thread::yield();
+    }
+  }
+};
+
+inline void thread_pool::execute(detail::pool_job* job) {
+  task_group* group = job->group;
+  job->fn();
+  delete job;
+  group->pending.fetch_sub(1, std::memory_order_release);
+}
+
+// Index of the calling thread among the threads of the executor running it:
+// its pool worker index, else its OpenMP thread number.
+inline unsigned executorThread() {
+  if (int worker = thread_pool::currentWorker(); worker >= 0)
+    return static_cast<unsigned>(worker);
+#ifdef _OPENMP
+  return static_cast<unsigned>(omp_get_thread_num());
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "matrix.hpp"
+#include "profile.hpp"
+
+// Cache tile sizes of the leaf multiply: a kc-deep slice of B that is nc
+// columns wide stays in L2 while mc rows of A stream through it.
+struct gemm_tiles {
+  std::size_t mc = 64;
+  std::size_t kc = 256;
+  std::size_t nc = 512;
+};
+
+// dest = lhs + rhs, element-wise.
+template <typename T>
+matrix_view<T> addInto(matrix_view<T> dest, const_matrix_view<T> lhs,
+                       const_matrix_view<T> rhs) {
+  STRASSEN_PROFILE_SCOPE(additions);
+  using W = kernel_t<T>;
+  for (std::size_t i = 0; i < dest.nrows(); ++i) {
+    const T *l = lhs[i], *r = rhs[i];
+    T* d = dest[i];
+#pragma omp simd
+    for (std::size_t j = 0; j < dest.ncols(); ++j)
+      d[j] = T(W(l[j]) + W(r[j]));
+  }
+  return dest;
+}
+
+// dest = lhs - rhs, element-wise.
+template <typename T>
+matrix_view<T> subtractInto(matrix_view<T> dest, const_matrix_view<T> lhs,
+                            const_matrix_view<T> rhs) {
+  STRASSEN_PROFILE_SCOPE(additions);
+  using W = kernel_t<T>;
+  for (std::size_t i = 0; i < dest.nrows(); ++i) {
+    const T *l = lhs[i], *r = rhs[i];
+    T* d = dest[i];
+#pragma omp simd
+    for (std::size_t j = 0; j < dest.ncols(); ++j)
+      d[j] = T(W(l[j]) - W(r[j]));
+  }
+  return dest;
+}
+
+namespace detail {
+
+// Register block of the micro-kernel: NR lanes of T fill one AVX-512 register
+// or two AVX2 registers per row of the accumulator.
+constexpr std::size_t kernel_mr = 4;
+template <typename T>
+constexpr std::size_t kernel_nr = 64 / sizeof(T);
+
+// Copies B[0:kc][0:nc] into NR-wide column strips, each stored as kc
+// contiguous rows of NR elements and zero-padded on the right edge, so every
+// micro-kernel call streams full vectors regardless of the view's shape.
+template <typename T>
+void packPanel(T* panel, std::size_t kc, std::size_t nc, const T* B,
+               std::size_t ldb) {
+  constexpr std::size_t nr_max = kernel_nr<T>;
+  for (std::size_t jr = 0; jr < nc; jr += nr_max) {
+    std::size_t nr = std::min(nr_max, nc - jr);
+    for (std::size_t k = 0; k < kc; ++k) {
+      const T* b = B + k * ldb + jr;
+      std::copy(b, b + nr, panel);
+      std::fill(panel + nr, panel + nr_max, T{});
+      panel += nr_max;
+    }
+  }
+}
+
+// C[0:MR][0:nr] += A[0:MR][0:kc] * strip[0:kc][0:nr]. The accumulator has a
+// compile-time shape, so it lives in vector registers for the whole k loop.
+template <std::size_t MR, typename T>
+void microKernel(std::size_t kc, const T* A, std::size_t lda, const T* strip,
+                 T* C, std::size_t ldc, std::size_t nr) {
+  using W = kernel_t<T>;
+  constexpr std::size_t nr_max = kernel_nr<T>;
+  W acc[MR][nr_max] = {};
+  for (std::size_t k = 0; k < kc; ++k) {
+    const T* b = strip + k * nr_max;
+    for (std::size_t r = 0; r < MR; ++r) {
+      W a = A[r * lda + k];
+#pragma omp simd
+      for (std::size_t c = 0; c < nr_max; ++c)
+        acc[r][c] += a * W(b[c]);
+    }
+  }
+  if (nr == nr_max) {
+    for (std::size_t r = 0; r < MR; ++r) {
+#pragma omp simd
+      for (std::size_t c = 0; c < nr_max; ++c)
+        C[r * ldc + c] = T(W(C[r * ldc + c]) + acc[r][c]);
+    }
+  } else {
+    for (std::size_t r = 0; r < MR; ++r) {
+      for (std::size_t c = 0; c < nr; ++c)
+        C[r * ldc + c] = T(W(C[r * ldc + c]) + acc[r][c]);
+    }
+  }
+}
+
+template <typename T>
+void microKernel(std::size_t mr, std::size_t kc, const T* A, std::size_t lda,
+                 const T* strip, T* C, std::size_t ldc, std::size_t nr) {
+  switch (mr) {
+    case 4:
+      return microKernel<4>(kc, A, lda, strip, C, ldc, nr);
+    case 3:
+      return microKernel<3>(kc, A, lda, strip, C, ldc, nr);
+    case 2:
+      return microKernel<2>(kc, A, lda, strip, C, ldc, nr);
+    default:
+      return microKernel<1>(kc, A, lda, strip, C, ldc, nr);
+  }
+}
+
+}  // namespace detail
+
+// C = A * B for the leaves of the Strassen recursion. The packed panel of B
+// is a per-thread buffer that is allocated once and reused by every leaf.
+template <typename T>
+void multiplyBlocked(matrix_view<T> C, const_matrix_view<T> A,
+                     const_matrix_view<T> B, const gemm_tiles& tiles = {}) {
+  using detail::kernel_mr;
+  constexpr std::size_t kernel_nr = detail::kernel_nr<T>;
+  static_assert(kernel_mr == 4, "microKernel dispatch covers 1..4 rows");
+
+  std::size_t m = C.nrows(), n = C.ncols(), depth = A.ncols();
+  for (std::size_t i = 0; i < m; ++i)
+    std::fill(C[i], C[i] + n, T{});
+
+  thread_local std::vector<T> panel;
+  std::size_t strips = (std::min(tiles.nc, n) + kernel_nr - 1) / kernel_nr;
+  std::size_t panel_size = std::min(tiles.kc, depth) * strips * kernel_nr;
+  if (panel.size() < panel_size)
+    panel.resize(panel_size);
+
+  for (std::size_t jc = 0; jc < n; jc += tiles.nc) {
+    std::size_t nc = std::min(tiles.nc, n - jc);
+    for (std::size_t pc = 0; pc < depth; pc += tiles.kc) {
+      std::size_t kc = std::min(tiles.kc, depth - pc);
+      detail::packPanel(panel.data(), kc, nc, B[pc] + jc, B.stride());
+
+      for (std::size_t ic = 0; ic < m; ic += tiles.mc) {
+        std::size_t mc = std::min(tiles.mc, m - ic);
+
+        for (std::size_t jr = 0; jr < nc; jr += kernel_nr) {
+          std::size_t nr = std::min(kernel_nr, nc - jr);
+          const T* strip = panel.data() + jr * kc;
+          for (std::size_t ir = 0; ir < mc; ir += kernel_mr) {
+            std::size_t mr = std::min(kernel_mr, mc - ir);
+            detail::microKernel(mr, kc, A[ic + ir] + pc, A.stride(), strip,
+                                C[ic + ir] + jc + jr, C.stride(), nr);
+          }
+        }
+      }
+    }
+  }
+}
@@ -1,22 +1,325 @@
 #pragma once
 
 #include <algorithm>
+#include <cassert>
 #include <iostream>
 #include <concepts>
+#include <functional>
 #include <iterator>
+#include <memory>
+#include <new>
 #include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include "profile.hpp"
+
+// Non-owning strided window into a row-major buffer: row i starts at
+// data() + i * stride(). Quadrants of a matrix are views with the parent's
+// stride, so recursive algorithms can split operands without copying them.
+template <typename T>
+class basic_matrix_view {
+  T* ptr = nullptr;
+  std::size_t rows = 0;
+  std::size_t cols = 0;
+  std::size_t ld = 0;
+
+ public:
+  basic_matrix_view() = default;
+
+  basic_matrix_view(T* ptr, std::size_t rows, std::size_t cols, std::size_t ld)
+      : ptr{ptr}, rows{rows}, cols{cols}, ld{ld} {}
+
+  template <typename U>
+    requires std::is_convertible_v<U (*)[], T (*)[]>
+  basic_matrix_view(const basic_matrix_view<U>& rhs)
+      : ptr{rhs.data()}, rows{rhs.nrows()}, cols{rhs.ncols()},
+        ld{rhs.stride()} {}
+
+  using value_type = std::remove_const_t<T>;
+
+  T* operator[](std::size_t idx) const { return ptr + ld * idx; }
+
+  basic_matrix_view block(std::size_t row_offset, std::size_t col_offset,
+                          std::size_t nrows, std::size_t ncols) const {
+    return basic_matrix_view{ptr + ld * row_offset + col_offset, nrows, ncols,
+                             ld};
+  }
+
+  // Quadrant (i, j), i, j in {0, 1}, of a view with even dimensions.
+  basic_matrix_view quadrant(unsigned i, unsigned j) const {
+    assert(rows % 2 == 0 && cols % 2 == 0);
+    std::size_t half_rows = rows / 2;
+    std::size_t half_cols = cols / 2;
+    return block(i * half_rows, j * half_cols, half_rows, half_cols);
+  }
+
+  T* data() const { return ptr; }
+  std::size_t nrows() const { return rows; }
+  std::size_t ncols() const { return cols; }
+  std::size_t stride() const { return ld; }
+
+  bool isSquare() const { return nrows() == ncols(); }
+};
+
+template <typename T>
+using matrix_view = basic_matrix_view<T>;
+
+// Read-only view. It is not a deduced context, so functions take T from their
+// output view and accept both mutable and read-only views as inputs.
+template <typename T>
+using const_matrix_view = std::type_identity_t<basic_matrix_view<const T>>;
+
+// Arithmetic type of the kernels for elements of type T. Signed integers
+// compute in their unsigned counterpart: overflow then wraps modulo 2^N (the
+// product stays exact modulo 2^N, like the plain product) instead of being
+// undefined, and the vectorizer treats it as ordinary lane arithmetic.
+// Floating-point types compute as themselves.
+template <typename T>
+constexpr auto kernelType() {
+  if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+    return std::type_identity<std::make_unsigned_t<T>>{};
+  else
+    return std::type_identity<T>{};
+}
+
+template <typename T>
+using kernel_t = typename decltype(kernelType<T>())::type;
+
+// Lazy element-wise arithmetic. lhs + rhs and lhs - rhs over matrices, views
+// and other expressions build an elementwise_expr instead of a result; the
+// whole expression is evaluated in one pass when it is assigned to a matrix or
+// to a view, so P1 + P4 - P5 + P7 reads each operand once and allocates
+// nothing but its destination. An expression refers to its operands, so it
+// must be evaluated before they go away.
+//
+// An expression has nrows(), ncols() and, like a view, operator[](i) that
+// returns something indexable by column: the elements of row i.
+template <typename E>
+concept matrix_expression = requires(const E& e, std::size_t i) {
+  typename E::value_type;
+  { e.nrows() } -> std::convertible_to<std::size_t>;
+  { e.ncols() } -> std::convertible_to<std::size_t>;
+  e[i][i];
+};
+
+template <typename Op, matrix_expression L, matrix_expression R>
+class elementwise_expr {
+  Op op;
+  L lhs;
+  R rhs;
+
+  template <typename LRow, typename RRow>
+  struct row {
+    Op op;
+    LRow lhs;
+    RRow rhs;
+
+    auto operator[](std::size_t idx) const { return op(lhs[idx], rhs[idx]); }
+  };
+
+ public:
+  static_assert(std::is_same_v<typename L::value_type, typename R::value_type>);
+  using value_type = typename L::value_type;
+
+  elementwise_expr(Op op, L lhs, R rhs) : op{op}, lhs{lhs}, rhs{rhs} {
+    if (lhs.nrows() != rhs.nrows() || lhs.ncols() != rhs.ncols())
+      throw std::runtime_error("Unsuitable matrix sizes");
+  }
+
+  auto operator[](std::size_t idx) const {
+    return row<decltype(lhs[idx]), decltype(rhs[idx])>{op, lhs[idx], rhs[idx]};
+  }
+
+  std::size_t nrows() const { return lhs.nrows(); }
+  std::size_t ncols() const { return lhs.ncols(); }
+};
+
+// dest = expr in a single pass. Elements are read and written at the same
+// position, so dest may also appear in expr.
+template <typename T, matrix_expression E>
+  requires std::is_same_v<T, typename E::value_type>
+matrix_view<T> assign(matrix_view<T> dest, const E& expr) {
+  if (dest.nrows() != expr.nrows() || dest.ncols() != expr.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  for (std::size_t i = 0; i < dest.nrows(); ++i) {
+    auto src = expr[i];
+    T* row = dest[i];
+#pragma omp simd
+    for (std::size_t j = 0; j < dest.ncols(); ++j)
+      row[j] = src[j];
+  }
+  return dest;
+}
+
+// Blocked transposes. The matrix is walked in transpose_block x
+// transpose_block blocks that fit in L1 together with their mirror image,
+// and every block in transpose_tile x transpose_tile tiles. A full tile goes
+// through a local array of compile-time shape that the compiler keeps in
+// vector registers, so both its loads and its stores are contiguous runs of
+// transpose_tile elements. Large matrices spread their blocks over the OpenMP
+// threads.
+namespace detail {
+
+constexpr std::size_t transpose_tile = 8;
+constexpr std::size_t transpose_block = 64;
+constexpr std::size_t transpose_parallel_min = 256 * 256;
+
+// dest[0:cols][0:rows] = src[0:rows][0:cols] transposed.
+template <typename T>
+void transposeTile(T* dest, std::size_t ldd, const T* src, std::size_t lds,
+                   std::size_t rows, std::size_t cols) {
+  constexpr std::size_t t = transpose_tile;
+  if (rows == t && cols == t) {
+    T tile[t][t];
+    for (std::size_t i = 0; i < t; ++i)
+      std::copy(src + i * lds, src + i * lds + t, tile[i]);
+    for (std::size_t j = 0; j < t; ++j)
+      for (std::size_t i = 0; i < t; ++i)
+        dest[j * ldd + i] = tile[i][j];
+    return;
+  }
+  for (std::size_t i = 0; i < rows; ++i)
+    for (std::size_t j = 0; j < cols; ++j)
+      dest[j * ldd + i] = src[i * lds + j];
+}
+
+// Swaps the rows x cols tile x with the transpose of the cols x rows tile y.
+// x and y may be the same diagonal tile, which is then transposed in place.
+template <typename T>
+void swapTransposedTiles(T* x, T* y, std::size_t ld, std::size_t rows,
+                         std::size_t cols) {
+  constexpr std::size_t t = transpose_tile;
+  T tx[t][t], ty[t][t];
+  if (rows == t && cols == t) {
+    for (std::size_t i = 0; i < t; ++i)
+      for (std::size_t j = 0; j < t; ++j) {
+        tx[j][i] = x[i * ld + j];
+        ty[j][i] = y[i * ld + j];
+      }
+    for (std::size_t i = 0; i < t; ++i) {
+      std::copy(ty[i], ty[i] + t, x + i * ld);
+      std::copy(tx[i], tx[i] + t, y + i * ld);
+    }
+    return;
+  }
+  for (std::size_t i = 0; i < rows; ++i)
+    for (std::size_t j = 0; j < cols; ++j) {
+      tx[j][i] = x[i * ld + j];
+      ty[i][j] = y[j * ld + i];
+    }
+  for (std::size_t i = 0; i < rows; ++i)
+    for (std::size_t j = 0; j < cols; ++j) {
+      x[i * ld + j] = ty[i][j];
+      y[j * ld + i] = tx[j][i];
+    }
+}
+
+}  // namespace detail
+
+// dest = src transposed; dest must not overlap src.
+template <typename T>
+void transposeInto(matrix_view<T> dest, const_matrix_view<T> src) {
+  using namespace detail;
+  if (dest.nrows() != src.ncols() || dest.ncols() != src.nrows())
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  std::size_t rows = src.nrows(), cols = src.ncols();
+#pragma omp parallel for collapse(2) schedule(static) \
+    if (rows * cols >= transpose_parallel_min)
+  for (std::size_t bi = 0; bi < rows; bi += transpose_block) {
+    for (std::size_t bj = 0; bj < cols; bj += transpose_block) {
+      std::size_t i_end = std::min(bi + transpose_block, rows);
+      std::size_t j_end = std::min(bj + transpose_block, cols);
+      for (std::size_t i = bi; i < i_end; i += transpose_tile)
+        for (std::size_t j = bj; j < j_end; j += transpose_tile)
+          transposeTile(dest[j] + i, dest.stride(), src[i] + j, src.stride(),
+                        std::min(transpose_tile, i_end - i),
+                        std::min(transpose_tile, j_end - j));
+    }
+  }
+}
+
+// Transposes a square view in place: the tiles above the diagonal trade
+// places with their mirror images below it, diagonal tiles turn over.
+template <typename T>
+void transposeInPlace(matrix_view<T> a) {
+  using namespace detail;
+  if (!a.isSquare())
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  std::size_t n = a.nrows();
+  // Rows of blocks hold fewer and fewer pairs towards the bottom.
+#pragma omp parallel for schedule(dynamic) if (n * n >= transpose_parallel_min)
+  for (std::size_t bi = 0; bi < n; bi += transpose_block) {
+    std::size_t i_end = std::min(bi + transpose_block, n);
+    for (std::size_t bj = bi; bj < n; bj += transpose_block) {
+      std::size_t j_end = std::min(bj + transpose_block, n);
+      for (std::size_t i = bi; i < i_end; i += transpose_tile) {
+        std::size_t j = bi == bj ? i : bj;
+        for (; j < j_end; j += transpose_tile)
+          swapTransposedTiles(a[i] + j, a[j] + i, a.stride(),
+                              std::min(transpose_tile, i_end - i),
+                              std::min(transpose_tile, j_end - j));
+      }
+    }
+  }
+}
+
+// Allocator that default-initializes the elements a vector is sized with, so
+// a buffer of arithmetic values is left untouched until first written.
+template <typename T>
+struct default_init_allocator : std::allocator<T> {
+  template <typename U>
+  struct rebind {
+    using other = default_init_allocator<U>;
+  };
+
+  using std::allocator<T>::allocator;
+
+  template <typename U>
+  void construct(U* ptr) {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args) {
+    ::new (static_cast<void*>(ptr)) U(std::forward<Args>(args)...);
+  }
+};
+
+// Selects the matrix constructor that leaves the elements uninitialized, for
+// results that are written in full and for operands filled in parallel: the
+// pages then belong to the NUMA node of the thread that first writes them.
+struct uninitialized_t {
+  explicit uninitialized_t() = default;
+};
+inline constexpr uninitialized_t uninitialized{};
+
+template <typename T>
 class matrix {
-  std::vector<int> buffer;
+  using storage = std::vector<T, default_init_allocator<T>>;
+
+  storage buffer;
   std::size_t rows = 0;
   std::size_t cols = 0;
 
  public:
   matrix() = default;
 
-  matrix(std::size_t rows, std::size_t cols, int val = {})
-      : buffer(rows * cols, val), rows{rows}, cols{cols} {}
+  matrix(std::size_t rows, std::size_t cols, T val = {})
+      : buffer(rows * cols, val), rows{rows}, cols{cols} {
+    STRASSEN_PROFILE_COUNT(allocations, 1);
+    STRASSEN_PROFILE_COUNT(allocated_bytes, buffer.size() * sizeof(T));
+  }
+
+  matrix(std::size_t rows, std::size_t cols, uninitialized_t)
+      : buffer(rows * cols), rows{rows}, cols{cols} {
+    STRASSEN_PROFILE_COUNT(allocations, 1);
+    STRASSEN_PROFILE_COUNT(allocated_bytes, buffer.size() * sizeof(T));
+  }
 
   template <std::input_iterator Iter>
   matrix(std::size_t rows, std::size_t cols, Iter frst, Iter lst)
@@ -33,37 +336,47 @@ class matrix {
   }
 
   matrix(const matrix& rhs)
-      : buffer(rhs.buffer), rows(rhs.rows), cols(rhs.cols) {}
+      : buffer(rhs.buffer), rows(rhs.rows), cols(rhs.cols) {
+    STRASSEN_PROFILE_COUNT(allocations, 1);
+    STRASSEN_PROFILE_COUNT(allocated_bytes, buffer.size() * sizeof(T));
+    STRASSEN_PROFILE_COUNT(copied_bytes, buffer.size() * sizeof(T));
+  }
+
+  template <matrix_expression E>
+    requires std::is_same_v<T, typename E::value_type>
+  matrix(const E& expr) : matrix{expr.nrows(), expr.ncols(), uninitialized} {
+    assign(view(), expr);
+  }
 
   static matrix square_unit(std::size_t size) { return matrix{size, size, 1}; }
 
  private:
   class proxy_row {
-    int* row_ptr = nullptr;
-    int* row_end_ptr = nullptr;
+    T* row_ptr = nullptr;
+    T* row_end_ptr = nullptr;
 
    public:
     proxy_row() = default;
-    proxy_row(int* begin_ptr, std::size_t cols)
+    proxy_row(T* begin_ptr, std::size_t cols)
         : row_ptr{begin_ptr}, row_end_ptr{row_ptr + cols} {}
 
-    int& operator[](std::size_t idx) { return row_ptr[idx]; }
-    const int& operator[](std::size_t idx) const { return row_ptr[idx]; }
+    T& operator[](std::size_t idx) { return row_ptr[idx]; }
+    const T& operator[](std::size_t idx) const { return row_ptr[idx]; }
 
     auto begin() const { return row_ptr; }
     auto end() const { return row_end_ptr; }
   };
 
   class const_proxy_row {
-    const int* row_ptr = nullptr;
-    const int* row_end_ptr = nullptr;
+    const T* row_ptr = nullptr;
+    const T* row_end_ptr = nullptr;
 
    public:
     const_proxy_row() = default;
-    const_proxy_row(const int* begin_ptr, std::size_t cols)
+    const_proxy_row(const T* begin_ptr, std::size_t cols)
         : row_ptr{begin_ptr}, row_end_ptr{row_ptr + cols} {}
 
-    const int& operator[](std::size_t idx) const { return row_ptr[idx]; }
+    const T& operator[](std::size_t idx) const { return row_ptr[idx]; }
 
     auto begin() const { return row_ptr; }
     auto end() const { return row_end_ptr; }
@@ -94,64 +407,65 @@ class matrix {
     return *this;
   }
 
-  matrix& operator+=(const matrix& rhs) {
-    if ((rows != rhs.rows) || (cols != rhs.cols))
-      throw std::runtime_error("Unsuitable matrix sizes");
+  matrix& operator=(matrix&& rhs) noexcept {
+    buffer = std::move(rhs.buffer);
+    rows = std::exchange(rhs.rows, 0);
+    cols = std::exchange(rhs.cols, 0);
+    return *this;
+  }
 
-    matrix tmp{rows, cols, begin(), end()};
-    std::transform(tmp.begin(), tmp.end(), rhs.begin(), tmp.begin(),
-                   std::plus<>());
-    *this = std::move(tmp);
+  // Evaluates expr in place when the sizes match, so no memory is allocated.
+  template <matrix_expression E>
+    requires std::is_same_v<T, typename E::value_type>
+  matrix& operator=(const E& expr) {
+    if (rows != expr.nrows() || cols != expr.ncols()) {
+      buffer.resize(expr.nrows() * expr.ncols());
+      rows = expr.nrows();
+      cols = expr.ncols();
+    }
+    assign(view(), expr);
     return *this;
   }
 
-  matrix& operator-=(const matrix& rhs) {
-    if ((rows != rhs.rows) || (cols != rhs.cols))
-      throw std::runtime_error("Unsuitable matrix sizes");
+  template <typename R>
+  matrix& operator+=(const R& rhs) {
+    return *this = *this + rhs;
+  }
 
-    matrix tmp{rows, cols, begin(), end()};
-    std::transform(tmp.begin(), tmp.end(), rhs.begin(), tmp.begin(),
-                   std::minus<>());
-    *this = std::move(tmp);
-    return *this;
+  template <typename R>
+  matrix& operator-=(const R& rhs) {
+    return *this = *this - rhs;
   }
 
-  matrix& operator*=(const matrix& rhs) {
-    if (cols != rhs.rows)
+  matrix& operator*=(const matrix& rhs) { return *this = *this * rhs; }
+
+  friend matrix operator*(const matrix& lhs, const matrix& rhs) {
+    if (lhs.cols != rhs.rows)
       throw std::runtime_error("Unsuitable matrix sizes");
 
-    matrix res{rows, rhs.cols};
-    matrix tmp{rhs};
-    tmp.transpose();
+    matrix res{lhs.rows, rhs.cols};
+    matrix tmp{rhs.cols, rhs.rows};
+    transposeInto(tmp.view(), rhs.view());
 
-    std::transform(res.begin(), res.end(), res.begin(), [&](int& elem) {
+    std::transform(res.begin(), res.end(), res.begin(), [&](T& elem) {
       auto i = (&elem - &res.buffer[0]) / res.ncols();
       auto j = (&elem - &res.buffer[0]) % res.ncols();
-      elem = std::inner_product((*this)[i].begin(), (*this)[i].end(),
-                                tmp[j].begin(), 0);
+      using W = kernel_t<T>;
+      elem = T(std::inner_product(
+          lhs[i].begin(), lhs[i].end(), tmp[j].begin(), W{}, std::plus<>{},
+          [](T a, T b) { return W(W(a) * W(b)); }));
       return elem;
     });
-
-    *this = std::move(res);
-    return *this;
+    return res;
   }
 
   matrix& transpose() & {
     if (isSquare()) {
-      std::for_each(begin(), end(), [this](int& elem) {
-        auto i = (&elem - &buffer[0]) / cols;
-        auto j = (&elem - &buffer[0]) % cols;
-        if (i < j)
-          std::swap((*this)[i][j], (*this)[j][i]);
-      });
+      transposeInPlace(view());
       return *this;
     }
     matrix transposed{cols, rows};
-    std::for_each(begin(), end(), [&](int& elem) {
-      auto i = (&elem - &buffer[0]) / cols;
-      auto j = (&elem - &buffer[0]) % cols;
-      transposed[j][i] = std::move(elem);
-    });
+    transposeInto(transposed.view(), view());
     *this = std::move(transposed);
     return *this;
   }
@@ -159,11 +473,18 @@ class matrix {
   std::size_t nrows() const { return rows; }
   std::size_t ncols() const { return cols; }
 
-  std::vector<int>::iterator begin() { return buffer.begin(); }
-  std::vector<int>::iterator end() { return buffer.end(); }
+  matrix_view<T> view() {
+    return matrix_view<T>{buffer.data(), rows, cols, cols};
+  }
+  const_matrix_view<T> view() const {
+    return const_matrix_view<T>{buffer.data(), rows, cols, cols};
+  }
+
+  typename storage::iterator begin() { return buffer.begin(); }
+  typename storage::iterator end() { return buffer.end(); }
 
-  std::vector<int>::const_iterator begin() const { return buffer.cbegin(); }
-  std::vector<int>::const_iterator end() const { return buffer.cend(); }
+  typename storage::const_iterator begin() const { return buffer.cbegin(); }
+  typename storage::const_iterator end() const { return buffer.cend(); }
 
   bool isSquare() const { return nrows() == ncols(); }
 
@@ -180,8 +501,50 @@ class matrix {
   }
 };
 
-// clang-format off
-matrix operator+(const matrix &lhs, const matrix &rhs) { auto res = lhs; res += rhs; return res; }
-matrix operator-(const matrix &lhs, const matrix &rhs) { auto res = lhs; res -= rhs; return res; }
-matrix operator*(const matrix &lhs, const matrix &rhs) { auto res = lhs; res *= rhs; return res; }
-// clang-format on
+// Operands of the lazy operators: matrices and views enter an expression as
+// read-only views, expressions by value.
+template <typename T>
+const_matrix_view<T> exprOperand(const matrix<T>& m) {
+  return m.view();
+}
+
+template <typename T>
+const_matrix_view<std::remove_const_t<T>> exprOperand(
+    const basic_matrix_view<T>& v) {
+  return v;
+}
+
+template <typename Op, typename L, typename R>
+const elementwise_expr<Op, L, R>& exprOperand(
+    const elementwise_expr<Op, L, R>& e) {
+  return e;
+}
+
+template <typename E>
+concept matrix_operand = requires(const E& e) { exprOperand(e); };
+
+// Element operations of the lazy operators, computed in kernel_t<T>.
+struct kernel_plus {
+  template <typename T>
+  T operator()(T lhs, T rhs) const {
+    return T(kernel_t<T>(lhs) + kernel_t<T>(rhs));
+  }
+};
+
+struct kernel_minus {
+  template <typename T>
+  T operator()(T lhs, T rhs) const {
+    return T(kernel_t<T>(lhs) - kernel_t<T>(rhs));
+  }
+};
+
+template <matrix_operand L, matrix_operand R>
+auto operator+(const L& lhs, const R& rhs) {
+  return elementwise_expr{kernel_plus{}, exprOperand(lhs), exprOperand(rhs)};
+}
+
+template <matrix_operand L, matrix_operand R>
+auto operator-(const L& lhs, const R& rhs) {
+  return elementwise_expr{kernel_minus{}, exprOperand(lhs), exprOperand(rhs)};
+}
+
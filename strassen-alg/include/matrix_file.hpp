@@ -0,0 +1,246 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matrix.hpp"
+#include "modular.hpp"
+
+// Binary matrix files: a 64-byte header, then the rows x cols elements in
+// row-major order, native byte order. The data starts on a 64-byte boundary
+// of the file, so a mapping of it is aligned for the vector kernels and can
+// be used as the storage of a matrix view without any copy or parsing.
+// Residues are stored as 32-bit values below the modulus in the header;
+// mappedMatrix() rejects a file holding any other value.
+
+enum class element_type : std::uint32_t {
+  int32 = 1,
+  int64,
+  float32,
+  float64,
+  modular32
+};
+
+template <typename T>
+constexpr element_type elementType() {
+  if constexpr (std::is_same_v<T, std::int32_t>)
+    return element_type::int32;
+  else if constexpr (std::is_same_v<T, std::int64_t>)
+    return element_type::int64;
+  else if constexpr (std::is_same_v<T, float>)
+    return element_type::float32;
+  else if constexpr (std::is_same_v<T, modular>)
+    return element_type::modular32;
+  else {
+    static_assert(std::is_same_v<T, double>, "Unsupported element type");
+    return element_type::float64;
+  }
+}
+
+inline std::size_t elementSize(element_type type) {
+  switch (type) {
+    case element_type::int32:
+    case element_type::float32:
+    case element_type::modular32:
+      return 4;
+    case element_type::int64:
+    case element_type::float64:
+      return 8;
+  }
+  throw std::runtime_error("Unknown element type");
+}
+
+struct matrix_file_header {
+  static constexpr char file_magic[8] = {'S', 'T', 'R', 'A',
+                                         'S', 'M', 'A', 'T'};
+  static constexpr std::uint32_t file_version = 1;
+
+  char magic[8];
+  std::uint32_t version;
+  element_type type;
+  std::uint64_t rows;
+  std::uint64_t cols;
+  // p of modular32 files, 0 otherwise.
+  std::uint32_t modulus;
+  std::uint8_t reserved[28];
+};
+static_assert(sizeof(matrix_file_header) == 64);
+
+// A whole file mapped into memory; unmapped on destruction.
+class mapped_file {
+  std::byte* addr = nullptr;
+  std::size_t length = 0;
+
+  mapped_file(std::byte* addr, std::size_t length)
+      : addr{addr}, length{length} {}
+
+  static std::runtime_error failure(const std::string& what,
+                                    const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " +
+                              std::strerror(errno));
+  }
+
+  // Sizes the open file fd to bytes and maps it shared; closes fd.
+  static mapped_file mapForWriting(int fd, std::size_t bytes,
+                                   const std::string& path) {
+    if (ftruncate(fd, bytes) != 0) {
+      ::close(fd);
+      throw failure("Cannot resize", path);
+    }
+    void* addr =
+        mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+      throw failure("Cannot map", path);
+    return mapped_file{static_cast<std::byte*>(addr), bytes};
+  }
+
+ public:
+  mapped_file() = default;
+
+  // Maps an existing file read-only and starts reading it ahead.
+  static mapped_file open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw failure("Cannot open", path);
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+      ::close(fd);
+      throw std::runtime_error("Empty or unreadable file " + path);
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED)
+      throw failure("Cannot map", path);
+    madvise(addr, st.st_size, MADV_WILLNEED);
+    return mapped_file{static_cast<std::byte*>(addr),
+                       static_cast<std::size_t>(st.st_size)};
+  }
+
+  // Creates or truncates path to bytes and maps it for writing; the contents
+  // reach the file as the kernel writes the dirty pages back.
+  static mapped_file create(const std::string& path, std::size_t bytes) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+      throw failure("Cannot create", path);
+    return mapForWriting(fd, bytes, path);
+  }
+
+  // A scratch file of bytes in dir, mapped for writing. It is unlinked
+  // right away: the kernel can page it out like any file, and its space is
+  // freed with the mapping.
+  static mapped_file temporary(const std::string& dir, std::size_t bytes) {
+    std::string path = dir + "/strassen-XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd < 0)
+      throw failure("Cannot create", path);
+    unlink(path.c_str());
+    return mapForWriting(fd, bytes, path);
+  }
+
+  mapped_file(mapped_file&& rhs) noexcept
+      : addr{std::exchange(rhs.addr, nullptr)},
+        length{std::exchange(rhs.length, 0)} {}
+
+  mapped_file& operator=(mapped_file&& rhs) noexcept {
+    std::swap(addr, rhs.addr);
+    std::swap(length, rhs.length);
+    return *this;
+  }
+
+  ~mapped_file() {
+    if (addr)
+      munmap(addr, length);
+  }
+
+  std::byte* data() const { return addr; }
+  std::size_t size() const { return length; }
+};
+
+// Header of a mapped matrix file, checked against the size of the file.
+inline const matrix_file_header& matrixHeader(const mapped_file& file) {
+  if (file.size() < sizeof(matrix_file_header))
+    throw std::runtime_error("Not a matrix file");
+  const auto& header =
+      *reinterpret_cast<const matrix_file_header*>(file.data());
+  if (std::memcmp(header.magic, matrix_file_header::file_magic,
+                  sizeof(header.magic)) != 0 ||
+      header.version != matrix_file_header::file_version)
+    throw std::runtime_error("Not a matrix file");
+  // rows * cols * size is checked before it is formed: a corrupt header
+  // must not wrap around to the actual size of the file
+  std::size_t size = elementSize(header.type);
+  if ((header.rows && header.cols > SIZE_MAX / size / header.rows) ||
+      file.size() != sizeof(matrix_file_header) +
+                         header.rows * header.cols * size)
+    throw std::runtime_error("Matrix file size does not match its header");
+  return header;
+}
+
+template <typename T>
+void checkElementType(const matrix_file_header& header) {
+  if (header.type != elementType<T>())
+    throw std::runtime_error("Matrix file holds another element type");
+  if constexpr (std::is_same_v<T, modular>)
+    if (header.modulus != modular::modulus())
+      throw std::runtime_error("Matrix file holds residues modulo another p");
+}
+
+// Arithmetic on residues assumes they are below p, so a file holding any
+// other value is refused instead of giving wrong products.
+inline void checkResidues(const modular* data, std::size_t count) {
+  std::uint32_t p = modular::modulus();
+  for (std::size_t i = 0; i < count; i++)
+    if (data[i].value() >= p)
+      throw std::runtime_error("Matrix file holds a residue not below p");
+}
+
+// The matrix stored in a mapped file, in place.
+template <typename T>
+const_matrix_view<T> mappedMatrix(const mapped_file& file) {
+  const auto& header = matrixHeader(file);
+  checkElementType<T>(header);
+  auto* data = reinterpret_cast<const T*>(file.data() + sizeof(header));
+  if constexpr (std::is_same_v<T, modular>)
+    checkResidues(data, header.rows * header.cols);
+  return const_matrix_view<T>{data, header.rows, header.cols, header.cols};
+}
+
+// Creates a rows x cols matrix file and returns its mapping; the matrix is
+// written through createdMatrix().
+template <typename T>
+mapped_file createMatrixFile(const std::string& path, std::size_t rows,
+                             std::size_t cols) {
+  auto file = mapped_file::create(
+      path, sizeof(matrix_file_header) + rows * cols * sizeof(T));
+  matrix_file_header header{};
+  std::memcpy(header.magic, matrix_file_header::file_magic,
+              sizeof(header.magic));
+  header.version = matrix_file_header::file_version;
+  header.type = elementType<T>();
+  if constexpr (std::is_same_v<T, modular>)
+    header.modulus = modular::modulus();
+  header.rows = rows;
+  header.cols = cols;
+  std::memcpy(file.data(), &header, sizeof(header));
+  return file;
+}
+
+template <typename T>
+matrix_view<T> createdMatrix(const mapped_file& file) {
+  const auto& header = matrixHeader(file);
+  checkElementType<T>(header);
+  auto* data = reinterpret_cast<T*>(file.data() + sizeof(header));
+  return matrix_view<T>{data, header.rows, header.cols, header.cols};
+}
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+
+// Residues modulo p for exact integer products (hashing, finite fields),
+// where plain int overflows.
+//
+// p is a run-time setting shared by all residues of the process and must be
+// below 2^31, so that the sum of two residues still fits in 32 bits. Sums
+// and differences are reduced with one unsigned min, which vectorizes like
+// plain integer arithmetic, so the Strassen additions stay as cheap as with
+// int. The leaf kernel reduces lazily: it accumulates 32 x 32-bit products in
+// 64-bit lanes and runs a Barrett reduction only when the next products
+// could overflow them, which for p below 2^20 or so means once per panel.
+class modular {
+  std::uint32_t v;
+
+  struct field {
+    std::uint64_t p;
+    // floor((2^64 - 1) / p) for the Barrett quotient.
+    std::uint64_t barrett;
+    // Products of two residues that fit on top of a reduced value in 64 bits.
+    std::uint64_t lazy_terms;
+  };
+
+  static field make(std::uint64_t p) {
+    auto max = std::numeric_limits<std::uint64_t>::max();
+    return field{p, max / p, (max - (p - 1)) / ((p - 1) * (p - 1))};
+  }
+
+  inline static field params = make(2147483647);
+
+  static modular raw(std::uint32_t value) {
+    modular r;
+    r.v = value;
+    return r;
+  }
+
+ public:
+  static constexpr std::uint64_t max_modulus = std::uint64_t{1} << 31;
+
+  // The residue r, which must already be below p.
+  static modular fromResidue(std::uint32_t r) { return raw(r); }
+
+  // Sets p for all residues. Existing residues keep their representatives,
+  // so set it before creating any.
+  static void setModulus(std::uint64_t p) {
+    if (p < 2 || p >= max_modulus)
+      throw std::runtime_error("Modulus must be in [2, 2^31)");
+    params = make(p);
+  }
+
+  static std::uint32_t modulus() { return params.p; }
+  static std::uint64_t barrett() { return params.barrett; }
+  static std::uint64_t lazyTerms() { return params.lazy_terms; }
+
+  // x mod p for any 64-bit x. The Barrett quotient floor(x * barrett / 2^64)
+  // is at most two below floor(x / p); its high product is assembled from
+  // 32 x 32-bit halves so the reduction vectorizes.
+  static std::uint64_t reduce(std::uint64_t x, std::uint64_t p,
+                              std::uint64_t barrett) {
+    constexpr std::uint64_t low = 0xffffffff;
+    std::uint64_t xh = x >> 32, xl = x & low;
+    std::uint64_t mh = barrett >> 32, ml = barrett & low;
+    std::uint64_t hl = xh * ml, lh = xl * mh;
+    std::uint64_t mid = ((xl * ml) >> 32) + (hl & low) + (lh & low);
+    std::uint64_t q = xh * mh + (hl >> 32) + (lh >> 32) + (mid >> 32);
+    std::uint64_t r = x - q * p;
+    r = std::min(r, r - p);
+    return std::min(r, r - p);
+  }
+
+  modular() = default;
+
+  template <std::integral I>
+  modular(I x) {
+    auto p = static_cast<std::int64_t>(params.p);
+    auto r = static_cast<std::int64_t>(x % static_cast<std::int64_t>(p));
+    v = static_cast<std::uint32_t>(r < 0 ? r + p : r);
+  }
+
+  std::uint32_t value() const { return v; }
+
+  // a + b and a - b wrap to 32 bits; for residues below p < 2^31 the wrong
+  // one of s and s -/+ p is always the larger unsigned value.
+  friend modular operator+(modular a, modular b) {
+    std::uint32_t s = a.v + b.v;
+    return raw(std::min(s, s - static_cast<std::uint32_t>(params.p)));
+  }
+  friend modular operator-(modular a, modular b) {
+    std::uint32_t d = a.v - b.v;
+    return raw(std::min(d, d + static_cast<std::uint32_t>(params.p)));
+  }
+  friend modular operator*(modular a, modular b) {
+    return raw(static_cast<std::uint32_t>(
+        reduce(std::uint64_t{a.v} * b.v, params.p, params.barrett)));
+  }
+  modular operator-() const { return modular{} - *this; }
+
+  modular& operator+=(modular rhs) { return *this = *this + rhs; }
+  modular& operator-=(modular rhs) { return *this = *this - rhs; }
+  modular& operator*=(modular rhs) { return *this = *this * rhs; }
+
+  friend bool operator==(modular a, modular b) { return a.v == b.v; }
+
+  friend std::ostream& operator<<(std::ostream& os, modular a) {
+    return os << a.v;
+  }
+};
+
+static_assert(std::is_trivial_v<modular>);
+
+#pragma omp declare reduction(+ : modular : omp_out += omp_in) \
+    initializer(omp_priv = modular{})
+
+// C = A * B mod p for the leaves of the Strassen recursion. Same blocking as
+// the generic kernel, but B is packed as raw 32-bit residues and every
+// register block accumulates exact 64-bit sums, reduced every lazyTerms()
+// steps of k and once more before it is stored.
+inline void multiplyBlocked(matrix_view<modular> C,
+                            const_matrix_view<modular> A,
+                            const_matrix_view<modular> B,
+                            const gemm_tiles& tiles = {}) {
+  constexpr std::size_t mr_max = detail::kernel_mr;
+  constexpr std::size_t nr_max = 16;
+  std::uint64_t p = modular::modulus(), barrett = modular::barrett();
+  std::uint64_t lazy = modular::lazyTerms();
+
+  std::size_t m = C.nrows(), n = C.ncols(), depth = A.ncols();
+  for (std::size_t i = 0; i < m; ++i)
+    std::fill(C[i], C[i] + n, modular{});
+
+  thread_local std::vector<std::uint32_t> panel;
+  std::size_t strips = (std::min(tiles.nc, n) + nr_max - 1) / nr_max;
+  std::size_t panel_size = std::min(tiles.kc, depth) * strips * nr_max;
+  if (panel.size() < panel_size)
+    panel.resize(panel_size);
+
+  for (std::size_t jc = 0; jc < n; jc += tiles.nc) {
+    std::size_t nc = std::min(tiles.nc, n - jc);
+    for (std::size_t pc = 0; pc < depth; pc += tiles.kc) {
+      std::size_t kc = std::min(tiles.kc, depth - pc);
+      std::uint32_t* packed = panel.data();
+      for (std::size_t jr = 0; jr < nc; jr += nr_max) {
+        std::size_t nr = std::min(nr_max, nc - jr);
+        for (std::size_t k = 0; k < kc; ++k, packed += nr_max) {
+          const modular* b = B[pc + k] + jc + jr;
+          for (std::size_t c = 0; c < nr_max; ++c)
+            packed[c] = c < nr ? b[c].value() : 0;
+        }
+      }
+
+      for (std::size_t ic = 0; ic < m; ic += mr_max) {
+        std::size_t mr = std::min(mr_max, m - ic);
+        for (std::size_t jr = 0; jr < nc; jr += nr_max) {
+          std::size_t nr = std::min(nr_max, nc - jr);
+          const std::uint32_t* strip = panel.data() + jr * kc;
+
+          std::uint64_t acc[mr_max][nr_max] = {};
+          for (std::size_t r = 0; r < mr; ++r)
+            for (std::size_t c = 0; c < nr; ++c)
+              acc[r][c] = C[ic + r][jc + jr + c].value();
+
+          for (std::size_t k0 = 0, k_end; k0 < kc; k0 = k_end) {
+            k_end = k0 + std::min<std::uint64_t>(lazy, kc - k0);
+            for (std::size_t k = k0; k < k_end; ++k) {
+              const std::uint32_t* b = strip + k * nr_max;
+              for (std::size_t r = 0; r < mr_max; ++r) {
+                std::uint64_t a =
+                    r < mr ? A[ic + r][pc + k].value() : 0;
+#pragma omp simd
+                for (std::size_t c = 0; c < nr_max; ++c)
+                  acc[r][c] += a * b[c];
+              }
+            }
+            for (std::size_t r = 0; r < mr_max; ++r) {
+#pragma omp simd
+              for (std::size_t c = 0; c < nr_max; ++c)
+                acc[r][c] = modular::reduce(acc[r][c], p, barrett);
+            }
+          }
+
+          for (std::size_t r = 0; r < mr; ++r)
+            for (std::size_t c = 0; c < nr; ++c)
+              C[ic + r][jc + jr + c] = modular::fromResidue(acc[r][c]);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "profile.hpp"
+#include "workspace.hpp"
+
+// Position of tile (bi, bj) in Morton (Z) order: the bits of the tile row and
+// column interleaved, row bit first, so the four quadrants of any aligned
+// 2^l x 2^l group of tiles follow each other as 11, 12, 21, 22.
+inline std::size_t mortonIndex(std::size_t bi, std::size_t bj) {
+  std::size_t index = 0;
+  for (unsigned bit = 0; (bi | bj) >> bit; ++bit) {
+    index |= ((bi >> bit) & 1) << (2 * bit + 1);
+    index |= ((bj >> bit) & 1) << (2 * bit);
+  }
+  return index;
+}
+
+// Tile (row, column) at position index in Morton order.
+inline std::pair<std::size_t, std::size_t> mortonTile(std::size_t index) {
+  std::size_t bi = 0, bj = 0;
+  for (unsigned bit = 0; index >> (2 * bit); ++bit) {
+    bi |= ((index >> (2 * bit + 1)) & 1) << bit;
+    bj |= ((index >> (2 * bit)) & 1) << bit;
+  }
+  return {bi, bj};
+}
+
+// Grid of 2^levels x 2^levels tiles stored in Morton order, every tile a
+// row-major tile_rows x tile_cols block. Each quadrant at every level is one
+// contiguous quarter of the parent, so the Strassen recursion streams through
+// memory instead of striding across rows.
+//
+// For the element-wise passes of the recursion the block is also a plain
+// row-major matrix of storage rows: nrows() rows of ncols() == tile_cols
+// elements, one after the other. Blocks of the same shape share that
+// structure element for element, so any element-wise formula over them can
+// run on their storage rows.
+template <typename T>
+class basic_morton_view {
+  T* ptr = nullptr;
+  unsigned grid_levels = 0;
+  std::size_t tile_rows = 0;
+  std::size_t tile_cols = 0;
+
+ public:
+  using value_type = std::remove_const_t<T>;
+
+  basic_morton_view() = default;
+
+  basic_morton_view(T* ptr, unsigned levels, std::size_t tile_rows,
+                    std::size_t tile_cols)
+      : ptr{ptr}, grid_levels{levels}, tile_rows{tile_rows},
+        tile_cols{tile_cols} {}
+
+  template <typename U>
+    requires std::is_convertible_v<U (*)[], T (*)[]>
+  basic_morton_view(const basic_morton_view<U>& rhs)
+      : ptr{rhs.data()}, grid_levels{rhs.levels()},
+        tile_rows{rhs.tileRows()}, tile_cols{rhs.tileCols()} {}
+
+  // Quadrant (i, j), i, j in {0, 1}, of a grid of at least 2 x 2 tiles.
+  basic_morton_view quadrant(unsigned i, unsigned j) const {
+    assert(grid_levels > 0);
+    return basic_morton_view{ptr + (2 * i + j) * (size() / 4),
+                             grid_levels - 1, tile_rows, tile_cols};
+  }
+
+  basic_matrix_view<T> tile(std::size_t bi, std::size_t bj) const {
+    return basic_matrix_view<T>{ptr + mortonIndex(bi, bj) * tile_rows *
+                                          tile_cols,
+                                tile_rows, tile_cols, tile_cols};
+  }
+
+  basic_matrix_view<T> storage() const {
+    return basic_matrix_view<T>{ptr, nrows(), tile_cols, tile_cols};
+  }
+
+  T* operator[](std::size_t idx) const { return ptr + tile_cols * idx; }
+
+  T* data() const { return ptr; }
+  std::size_t size() const { return nrows() * tile_cols; }
+  std::size_t nrows() const {
+    return (std::size_t{1} << 2 * grid_levels) * tile_rows;
+  }
+  std::size_t ncols() const { return tile_cols; }
+
+  unsigned levels() const { return grid_levels; }
+  std::size_t tileRows() const { return tile_rows; }
+  std::size_t tileCols() const { return tile_cols; }
+  // Side lengths of the whole grid.
+  std::size_t gridRows() const { return tile_rows << grid_levels; }
+  std::size_t gridCols() const { return tile_cols << grid_levels; }
+};
+
+template <typename T>
+using morton_view = basic_morton_view<T>;
+
+template <typename T>
+using const_morton_view = std::type_identity_t<basic_morton_view<const T>>;
+
+// Owning Morton-tiled matrix. Its grid may be larger than the row-major matrix
+// it holds; toMorton() fills the padding with zeros, which leaves products of
+// padded operands unchanged in the original corner.
+template <typename T>
+class morton_matrix {
+  std::vector<T> buffer;
+  unsigned grid_levels = 0;
+  std::size_t tile_rows = 0;
+  std::size_t tile_cols = 0;
+
+ public:
+  morton_matrix(unsigned levels, std::size_t tile_rows, std::size_t tile_cols)
+      : buffer((std::size_t{1} << 2 * levels) * tile_rows * tile_cols),
+        grid_levels{levels}, tile_rows{tile_rows}, tile_cols{tile_cols} {}
+
+  morton_view<T> view() {
+    return morton_view<T>{buffer.data(), grid_levels, tile_rows, tile_cols};
+  }
+  const_morton_view<T> view() const {
+    return const_morton_view<T>{buffer.data(), grid_levels, tile_rows,
+                                tile_cols};
+  }
+};
+
+// dest = src, zero-padded to the grid of dest. Tiles are independent, so
+// they are spread over the threads of the enclosing parallel region.
+template <typename T>
+void toMorton(morton_view<T> dest, const_matrix_view<T> src) {
+  if (dest.gridRows() < src.nrows() || dest.gridCols() < src.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+  STRASSEN_PROFILE_COUNT(copied_bytes, dest.size() * sizeof(T));
+
+  std::size_t side = std::size_t{1} << dest.levels();
+  #pragma omp taskloop collapse(2)
+  for (std::size_t bi = 0; bi < side; ++bi) {
+    for (std::size_t bj = 0; bj < side; ++bj) {
+      auto tile = dest.tile(bi, bj);
+      std::size_t row0 = bi * dest.tileRows(), col0 = bj * dest.tileCols();
+      std::size_t rows = std::min(tile.nrows(),
+                                  src.nrows() - std::min(row0, src.nrows()));
+      std::size_t cols = std::min(tile.ncols(),
+                                  src.ncols() - std::min(col0, src.ncols()));
+      for (std::size_t i = 0; i < tile.nrows(); ++i) {
+        std::size_t filled = 0;
+        if (i < rows) {
+          std::copy(src[row0 + i] + col0, src[row0 + i] + col0 + cols,
+                    tile[i]);
+          filled = cols;
+        }
+        std::fill(tile[i] + filled, tile[i] + tile.ncols(), T{});
+      }
+    }
+  }
+}
+
+// dest = the top-left dest.nrows() x dest.ncols() corner of src.
+template <typename T>
+void fromMorton(matrix_view<T> dest, const_morton_view<T> src) {
+  if (src.gridRows() < dest.nrows() || src.gridCols() < dest.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+  STRASSEN_PROFILE_COUNT(copied_bytes,
+                         dest.nrows() * dest.ncols() * sizeof(T));
+
+  std::size_t tiles_down =
+      (dest.nrows() + src.tileRows() - 1) / src.tileRows();
+  std::size_t tiles_across =
+      (dest.ncols() + src.tileCols() - 1) / src.tileCols();
+  #pragma omp taskloop collapse(2)
+  for (std::size_t bi = 0; bi < tiles_down; ++bi) {
+    for (std::size_t bj = 0; bj < tiles_across; ++bj) {
+      auto tile = src.tile(bi, bj);
+      std::size_t row0 = bi * src.tileRows(), col0 = bj * src.tileCols();
+      std::size_t rows = std::min(tile.nrows(), dest.nrows() - row0);
+      std::size_t cols = std::min(tile.ncols(), dest.ncols() - col0);
+      for (std::size_t i = 0; i < rows; ++i)
+        std::copy(tile[i], tile[i] + cols, dest[row0 + i] + col0);
+    }
+  }
+}
+
+// Element-wise operations on Morton blocks run on their storage rows.
+
+template <typename T>
+morton_view<T> addInto(morton_view<T> dest, const_morton_view<T> lhs,
+                       const_morton_view<T> rhs) {
+  addInto(dest.storage(), lhs.storage(), rhs.storage());
+  return dest;
+}
+
+template <typename T>
+morton_view<T> subtractInto(morton_view<T> dest, const_morton_view<T> lhs,
+                            const_morton_view<T> rhs) {
+  subtractInto(dest.storage(), lhs.storage(), rhs.storage());
+  return dest;
+}
+
+template <typename T>
+const_matrix_view<std::remove_const_t<T>> exprOperand(
+    const basic_morton_view<T>& v) {
+  return v.storage();
+}
+
+template <typename T, matrix_expression E>
+  requires std::is_same_v<T, typename E::value_type>
+morton_view<T> assign(morton_view<T> dest, const E& expr) {
+  assign(dest.storage(), expr);
+  return dest;
+}
+
+// Scratch block of the same shape as v.
+template <typename T>
+morton_view<std::remove_const_t<T>> acquireLike(workspace::frame& frame,
+                                                const basic_morton_view<T>& v) {
+  auto storage = frame.acquire<std::remove_const_t<T>>(v.nrows(), v.ncols());
+  return morton_view<std::remove_const_t<T>>{storage.data(), v.levels(),
+                                             v.tileRows(), v.tileCols()};
+}
@@ -0,0 +1,329 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "matrix_file.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
+
+// Strassen for operands that do not fit in memory, e.g. A, B and C in
+// memory-mapped matrix files.
+//
+// While a product exceeds the memory budget, its level runs out of core: the
+// seven products are computed one after the other, their operand sums and
+// their result go to unlinked scratch files of one quadrant each, and every
+// product is added into the quadrants of C as soon as it is done. The kernel
+// pages the operands in and the scratch and C pages out as needed; nothing
+// above the budget is ever held at once. While one product computes, the
+// operands of the next one are read ahead (MADV_WILLNEED). Once a product
+// fits, operands, result and arenas, it goes to algorithmStrassen in memory.
+// Odd dimensions are peeled off into streaming row and column updates.
+
+struct out_of_core_params {
+  // Bytes a product may take to run in memory: its operands, its result and
+  // the arenas of all threads.
+  std::size_t memory_budget = std::size_t{1} << 30;
+  // Directory of the scratch files.
+  std::string scratch_dir = "/tmp";
+  // Threads of the in-memory products and of the additions.
+  unsigned threads = 1;
+};
+
+// Memory taken by a run: the largest arenas of an in-memory product, and the
+// peak size of the scratch files.
+struct out_of_core_stats {
+  std::size_t arena_bytes = 0;
+  std::size_t scratch_file_bytes = 0;
+};
+
+namespace detail {
+
+// Applies advice to the pages under the rows of v. Rows further apart than a
+// page are advised one by one, so a narrow quadrant does not drag the whole
+// width of its parent along.
+template <typename T>
+void adviseRows(basic_matrix_view<T> v, int advice) {
+  if (v.nrows() == 0 || v.ncols() == 0)
+    return;
+  const std::uintptr_t page = sysconf(_SC_PAGESIZE);
+  auto range = [&](const void* first, const void* last) {
+    auto lo = reinterpret_cast<std::uintptr_t>(first) / page * page;
+    auto hi = reinterpret_cast<std::uintptr_t>(last);
+    madvise(reinterpret_cast<void*>(lo), hi - lo, advice);
+  };
+  if ((v.stride() - v.ncols()) * sizeof(T) < page) {
+    range(v[0], v[v.nrows() - 1] + v.ncols());
+    return;
+  }
+  for (std::size_t i = 0; i < v.nrows(); ++i)
+    range(v[i], v[i] + v.ncols());
+}
+
+template <typename T>
+class out_of_core_runner {
+  enum class update { assign, add, subtract };
+
+  // An operand of a product: x alone, or x + y or x - y.
+  struct operand {
+    const_matrix_view<T> x;
+    const_matrix_view<T> y = {};
+    bool subtract = false;
+
+    bool sum() const { return y.data() != nullptr; }
+  };
+
+  struct target {
+    matrix_view<T> quadrant;
+    update how;
+  };
+
+  struct product {
+    operand a, b;
+    std::vector<target> into;
+  };
+
+  const out_of_core_params& config;
+  strassen_params params;
+  std::optional<workspace> ws;
+  std::size_t scratch_bytes = 0;
+  out_of_core_stats stats;
+
+  bool fits(std::size_t m, std::size_t k, std::size_t n) const {
+    std::size_t operands = (m * k + k * n + m * n) * sizeof(T);
+    // The Morton layout adds a tiled copy of all three.
+    if (params.storage == layout::morton)
+      operands *= 2;
+    return operands + strassenScratch<T>(m, k, n, params) * config.threads <=
+           config.memory_budget;
+  }
+
+  void inMemory(const_matrix_view<T> A, const_matrix_view<T> B,
+                matrix_view<T> C) {
+    std::size_t need = strassenScratch<T>(A.nrows(), A.ncols(), B.ncols(),
+                                          params);
+    unsigned workers = params.pool ? params.pool->size() : config.threads;
+    if (!ws || ws->reservedBytes() < need * workers) {
+      ws.reset();
+      ws.emplace(need, workers);
+      stats.arena_bytes = std::max(stats.arena_bytes, ws->reservedBytes());
+    }
+    if (params.pool) {
+      params.pool->run([&] { algorithmStrassen(A, B, C, *ws, params); });
+      return;
+    }
+#pragma omp parallel num_threads(config.threads)
+{
+  #pragma omp single
+    algorithmStrassen(A, B, C, *ws, params);
+}
+  }
+
+  mapped_file scratch(std::size_t rows, std::size_t cols) {
+    auto file = mapped_file::temporary(config.scratch_dir,
+                                       rows * cols * sizeof(T));
+    scratch_bytes += file.size();
+    stats.scratch_file_bytes =
+        std::max(stats.scratch_file_bytes, scratch_bytes);
+    return file;
+  }
+
+  void drop(const mapped_file& file) { scratch_bytes -= file.size(); }
+
+  static matrix_view<T> scratchView(const mapped_file& file,
+                                    std::size_t rows, std::size_t cols) {
+    return matrix_view<T>{reinterpret_cast<T*>(file.data()), rows, cols,
+                          cols};
+  }
+
+  void prefetch(const operand& op) {
+    adviseRows(op.x, MADV_WILLNEED);
+    if (op.sum())
+      adviseRows(op.y, MADV_WILLNEED);
+  }
+
+  // op as a view: the quadrant itself, or its sum written to into.
+  const_matrix_view<T> materialize(const operand& op, matrix_view<T> into) {
+    if (!op.sum())
+      return op.x;
+#pragma omp parallel for schedule(static) num_threads(config.threads)
+    for (std::size_t i = 0; i < into.nrows(); ++i) {
+      auto row = into.block(i, 0, 1, into.ncols());
+      if (op.subtract)
+        subtractInto(row, op.x.block(i, 0, 1, into.ncols()),
+                     op.y.block(i, 0, 1, into.ncols()));
+      else
+        addInto(row, op.x.block(i, 0, 1, into.ncols()),
+                op.y.block(i, 0, 1, into.ncols()));
+    }
+    return into;
+  }
+
+  void apply(const target& t, const_matrix_view<T> P) {
+    auto C = t.quadrant;
+#pragma omp parallel for schedule(static) num_threads(config.threads)
+    for (std::size_t i = 0; i < C.nrows(); ++i) {
+      auto row = C.block(i, 0, 1, C.ncols());
+      auto p = P.block(i, 0, 1, C.ncols());
+      switch (t.how) {
+        case update::assign:
+          std::copy(p[0], p[0] + C.ncols(), row[0]);
+          break;
+        case update::add:
+          addInto(row, row, p);
+          break;
+        case update::subtract:
+          subtractInto(row, row, p);
+          break;
+      }
+    }
+  }
+
+  // One classic Strassen level on even dimensions, each product added into
+  // C before the next one starts.
+  void step(const_matrix_view<T> A, const_matrix_view<T> B,
+            matrix_view<T> C) {
+    auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+    auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+    auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+    auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+    auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+    auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+    constexpr auto assign = update::assign, add = update::add,
+                   subtract = update::subtract;
+
+    // C11 = P1 + P4 - P5 + P7, C12 = P3 + P5, C21 = P2 + P4,
+    // C22 = P1 - P2 + P3 + P6.
+    const product products[] = {
+        {{A11, A22}, {B11, B22}, {{C11, assign}, {C22, assign}}},
+        {{A21, A22}, {B11}, {{C21, assign}, {C22, subtract}}},
+        {{A11}, {B12, B22, true}, {{C12, assign}, {C22, add}}},
+        {{A22}, {B21, B11, true}, {{C11, add}, {C21, add}}},
+        {{A11, A12}, {B22}, {{C11, subtract}, {C12, add}}},
+        {{A21, A11, true}, {B11, B12}, {{C22, add}}},
+        {{A12, A22, true}, {B21, B22}, {{C11, add}}},
+    };
+
+    std::size_t m = A11.nrows(), k = A11.ncols(), n = B11.ncols();
+    auto sa_file = scratch(m, k), sb_file = scratch(k, n);
+    auto p_file = scratch(m, n);
+    auto Sa = scratchView(sa_file, m, k), Sb = scratchView(sb_file, k, n);
+    auto P = scratchView(p_file, m, n);
+
+    prefetch(products[0].a);
+    prefetch(products[0].b);
+    for (std::size_t i = 0; i < std::size(products); ++i) {
+      const auto& p = products[i];
+      auto a = materialize(p.a, Sa);
+      auto b = materialize(p.b, Sb);
+      if (i + 1 < std::size(products)) {
+        prefetch(products[i + 1].a);
+        prefetch(products[i + 1].b);
+      }
+      multiply(a, b, P);
+      for (const auto& t : p.into)
+        apply(t, P);
+    }
+    drop(sa_file);
+    drop(sb_file);
+    drop(p_file);
+  }
+
+  // The even core through multiply(), then the odd column of A and row of
+  // B as a rank-1 update, the odd column of C as dot products with a copy of
+  // the odd column of B, and the odd row of C as a row of A times B. Each
+  // streams its operands once.
+  void peel(const_matrix_view<T> A, const_matrix_view<T> B,
+            matrix_view<T> C) {
+    std::size_t m = C.nrows(), k = A.ncols(), n = C.ncols();
+    std::size_t m_lo = m & ~std::size_t{1};
+    std::size_t k_lo = k & ~std::size_t{1};
+    std::size_t n_lo = n & ~std::size_t{1};
+
+    auto core = C.block(0, 0, m_lo, n_lo);
+    multiply(A.block(0, 0, m_lo, k_lo), B.block(0, 0, k_lo, n_lo), core);
+
+    using W = kernel_t<T>;
+    if (k != k_lo) {
+      const T* b = B[k_lo];
+#pragma omp parallel for schedule(static) num_threads(config.threads)
+      for (std::size_t i = 0; i < m_lo; ++i) {
+        W a = A[i][k_lo];
+        T* c = core[i];
+        for (std::size_t j = 0; j < n_lo; ++j)
+          c[j] = T(W(c[j]) + a * W(b[j]));
+      }
+    }
+    if (n != n_lo) {
+      std::vector<T> column(k);
+      for (std::size_t p = 0; p < k; ++p)
+        column[p] = B[p][n_lo];
+#pragma omp parallel for schedule(static) num_threads(config.threads)
+      for (std::size_t i = 0; i < m_lo; ++i) {
+        const T* a = A[i];
+        W dot{};
+#pragma omp simd reduction(+ : dot)
+        for (std::size_t p = 0; p < k; ++p)
+          dot += W(a[p]) * W(column[p]);
+        C[i][n_lo] = T(dot);
+      }
+    }
+    if (m != m_lo)
+      multiplyBlocked(C.block(m_lo, 0, 1, n), A.block(m_lo, 0, 1, k), B,
+                      params.tiles);
+  }
+
+ public:
+  out_of_core_runner(const out_of_core_params& config,
+                     const strassen_params& params)
+      : config{config}, params{params} {}
+
+  void multiply(const_matrix_view<T> A, const_matrix_view<T> B,
+                matrix_view<T> C) {
+    std::size_t m = A.nrows(), k = A.ncols(), n = B.ncols();
+    if (std::min({m, k, n}) <= params.leaf || fits(m, k, n))
+      inMemory(A, B, C);
+    else if (m % 2 == 0 && k % 2 == 0 && n % 2 == 0)
+      step(A, B, C);
+    else
+      peel(A, B, C);
+  }
+
+  const out_of_core_stats& statistics() const { return stats; }
+};
+
+}  // namespace detail
+
+// C = A * B under config.memory_budget, with the top levels of the
+// recursion out of core. Call it outside of any parallel region; it runs its
+// own, or the products on params.pool.
+template <typename T>
+out_of_core_stats multiplyOutOfCore(const_matrix_view<T> A,
+                                    const_matrix_view<T> B, matrix_view<T> C,
+                                    const strassen_params& params,
+                                    const out_of_core_params& config) {
+  if (A.ncols() != B.nrows() || C.nrows() != A.nrows() ||
+      C.ncols() != B.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+  if (config.threads == 0)
+    throw std::runtime_error("Out-of-core mode needs a thread");
+
+  detail::out_of_core_runner<T> runner{config, params};
+  runner.multiply(A, B, C);
+  return runner.statistics();
+}
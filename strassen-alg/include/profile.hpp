@@ -0,0 +1,272 @@
+#pragma once
+
+// Instrumentation of the Strassen recursion, compiled in with
+// -DSTRASSEN_PROFILE and removed entirely otherwise.
+//
+// Every thread keeps, per recursion level, the time spent in each phase of a
+// level and counters of arena and heap allocations, bytes copied and tasks
+// spawned. Phase times are exclusive: a scope that runs nested scopes (a
+// task waiting while it executes other tasks, a product that recurses) is
+// charged only for the time outside them. With tracing on, every scope is
+// also recorded as a Chrome trace event (chrome://tracing, Perfetto), one
+// track per thread, which shows how the seven products of each level spread
+// over the threads.
+
+#ifdef STRASSEN_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace profile {
+
+enum class phase { additions, copies, leaf, combine, wait, task };
+constexpr std::size_t phase_count = 6;
+constexpr const char* phase_names[phase_count] = {
+    "additions", "copies", "leaf", "combine", "wait", "task"};
+
+enum class counter { allocations, allocated_bytes, copied_bytes, tasks };
+constexpr std::size_t counter_count = 4;
+
+// Levels deeper than this are charged to the last one. Work outside the
+// recursion is level -1 and goes to its own bucket.
+constexpr int max_level = 30;
+
+struct level_stats {
+  std::uint64_t ns[phase_count] = {};
+  std::uint64_t calls[phase_count] = {};
+  std::uint64_t counts[counter_count] = {};
+};
+
+struct trace_event {
+  const char* name;
+  int level;
+  std::uint64_t start_ns;
+  std::uint64_t duration_ns;
+};
+
+class scope;
+
+struct thread_record {
+  std::size_t id = 0;
+  level_stats levels[max_level + 2];
+  std::vector<trace_event> events;
+  int level = -1;
+  scope* current = nullptr;
+
+  level_stats& stats() { return levels[std::min(level, max_level) + 1]; }
+};
+
+class registry {
+  std::mutex mutex;
+  std::vector<std::unique_ptr<thread_record>> threads;
+  std::chrono::steady_clock::time_point origin =
+      std::chrono::steady_clock::now();
+  bool tracing = false;
+
+ public:
+  static registry& instance() {
+    static registry r;
+    return r;
+  }
+
+  thread_record& local() {
+    thread_local thread_record* record = nullptr;
+    if (!record) {
+      std::lock_guard lock{mutex};
+      threads.push_back(std::make_unique<thread_record>());
+      record = threads.back().get();
+      record->id = threads.size() - 1;
+    }
+    return *record;
+  }
+
+  std::uint64_t now() const {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now() - origin)
+        .count();
+  }
+
+  bool tracingEnabled() const { return tracing; }
+
+  // Clears the statistics of all threads; call it between runs, outside any
+  // parallel region.
+  void reset(bool trace) {
+    std::lock_guard lock{mutex};
+    for (auto& t : threads) {
+      std::fill(std::begin(t->levels), std::end(t->levels), level_stats{});
+      t->events.clear();
+    }
+    tracing = trace;
+    origin = std::chrono::steady_clock::now();
+  }
+
+  void printSummary(std::ostream& os) {
+    std::lock_guard lock{mutex};
+    auto ms = [](std::uint64_t ns) { return ns / 1e6; };
+    auto mb = [](std::uint64_t bytes) { return bytes / 1048576.0; };
+
+    os << "Per level (times in ms, summed over threads)\n";
+    os << std::setw(6) << "level";
+    for (const char* name : phase_names)
+      os << std::setw(11) << name;
+    os << std::setw(8) << "allocs" << std::setw(10) << "alloc MB"
+       << std::setw(10) << "copy MB" << std::setw(7) << "tasks" << '\n';
+    os << std::fixed << std::setprecision(2);
+    for (int level = -1; level <= max_level; ++level) {
+      level_stats sum;
+      for (auto& t : threads) {
+        const auto& s = t->levels[level + 1];
+        for (std::size_t p = 0; p < phase_count; ++p) {
+          sum.ns[p] += s.ns[p];
+          sum.calls[p] += s.calls[p];
+        }
+        for (std::size_t c = 0; c < counter_count; ++c)
+          sum.counts[c] += s.counts[c];
+      }
+      if (std::all_of(std::begin(sum.calls), std::end(sum.calls),
+                      [](auto c) { return c == 0; }) &&
+          std::all_of(std::begin(sum.counts), std::end(sum.counts),
+                      [](auto c) { return c == 0; }))
+        continue;
+
+      if (level < 0)
+        os << std::setw(6) << "-";
+      else
+        os << std::setw(6) << level;
+      for (std::size_t p = 0; p < phase_count; ++p)
+        os << std::setw(11) << ms(sum.ns[p]);
+      os << std::setw(8) << sum.counts[0] << std::setw(10)
+         << mb(sum.counts[1]) << std::setw(10) << mb(sum.counts[2])
+         << std::setw(7) << sum.counts[3] << '\n';
+    }
+
+    os << "Per thread (ms)\n";
+    os << std::setw(6) << "thread";
+    for (const char* name : phase_names)
+      os << std::setw(11) << name;
+    os << '\n';
+    for (auto& t : threads) {
+      os << std::setw(6) << t->id;
+      for (std::size_t p = 0; p < phase_count; ++p) {
+        std::uint64_t ns = 0;
+        for (const auto& s : t->levels)
+          ns += s.ns[p];
+        os << std::setw(11) << ms(ns);
+      }
+      os << '\n';
+    }
+    os.unsetf(std::ios::floatfield);
+  }
+
+  // Chrome trace-event JSON: one complete ("X") event per scope.
+  void writeTrace(std::ostream& os) {
+    std::lock_guard lock{mutex};
+    os << "{\"traceEvents\": [\n";
+    bool first = true;
+    for (auto& t : threads) {
+      for (const auto& e : t->events) {
+        os << (first ? "" : ",\n") << "  {\"name\": \"" << e.name
+           << "\", \"cat\": \"level " << e.level
+           << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": " << t->id
+           << ", \"ts\": " << e.start_ns / 1e3
+           << ", \"dur\": " << e.duration_ns / 1e3
+           << ", \"args\": {\"level\": " << e.level << "}}";
+        first = false;
+      }
+    }
+    os << "\n]}\n";
+  }
+};
+
+// Sets the recursion level of the calling thread for its lifetime.
+class level_scope {
+  thread_record& record;
+  int saved;
+
+ public:
+  explicit level_scope(int level)
+      : record{registry::instance().local()}, saved{record.level} {
+    record.level = level;
+  }
+  level_scope(const level_scope&) = delete;
+  level_scope& operator=(const level_scope&) = delete;
+  ~level_scope() { record.level = saved; }
+};
+
+// Times one phase at the current level of the calling thread.
+class scope {
+  thread_record& record;
+  phase which;
+  const char* name;
+  scope* parent;
+  std::uint64_t start;
+  std::uint64_t nested = 0;
+
+ public:
+  explicit scope(phase which, const char* name = nullptr)
+      : record{registry::instance().local()}, which{which},
+        name{name ? name : phase_names[static_cast<std::size_t>(which)]},
+        parent{record.current}, start{registry::instance().now()} {
+    record.current = this;
+  }
+  scope(const scope&) = delete;
+  scope& operator=(const scope&) = delete;
+
+  ~scope() {
+    auto& reg = registry::instance();
+    std::uint64_t duration = reg.now() - start;
+    auto& s = record.stats();
+    s.ns[static_cast<std::size_t>(which)] += duration - nested;
+    s.calls[static_cast<std::size_t>(which)] += 1;
+    if (parent)
+      parent->nested += duration;
+    record.current = parent;
+    if (reg.tracingEnabled())
+      record.events.push_back({name, record.level, start, duration});
+  }
+};
+
+inline void count(counter which, std::uint64_t amount) {
+  registry::instance().local().stats().counts[static_cast<std::size_t>(
+      which)] += amount;
+}
+
+}  // namespace profile
+
+#define STRASSEN_PROFILE_JOIN2(a, b) a##b
+#define STRASSEN_PROFILE_JOIN(a, b) STRASSEN_PROFILE_JOIN2(a, b)
+
+// Recursion level of everything the enclosing block does on this thread.
+#define STRASSEN_PROFILE_LEVEL(depth)                                    \
+  ::profile::level_scope STRASSEN_PROFILE_JOIN(profile_level_, __LINE__) { \
+    static_cast<int>(depth)                                              \
+  }
+// Charges the rest of the enclosing block to a phase.
+#define STRASSEN_PROFILE_SCOPE(which)                               \
+  ::profile::scope STRASSEN_PROFILE_JOIN(profile_scope_, __LINE__) { \
+    ::profile::phase::which                                         \
+  }
+// A task body: sets its level and shows up in the trace under name.
+#define STRASSEN_PROFILE_TASK(name, depth) \
+  STRASSEN_PROFILE_LEVEL(depth);           \
+  ::profile::scope STRASSEN_PROFILE_JOIN(profile_task_, __LINE__) { \
+    ::profile::phase::task, name                                    \
+  }
+#define STRASSEN_PROFILE_COUNT(which, amount) \
+  ::profile::count(::profile::counter::which, (amount))
+
+#else
+
+#define STRASSEN_PROFILE_LEVEL(depth) static_cast<void>(0)
+#define STRASSEN_PROFILE_SCOPE(which) static_cast<void>(0)
+#define STRASSEN_PROFILE_TASK(name, depth) static_cast<void>(0)
+#define STRASSEN_PROFILE_COUNT(which, amount) static_cast<void>(0)
+
+#endif
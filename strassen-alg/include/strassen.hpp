@@ -0,0 +1,699 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+#include "executor.hpp"
+#include "kernels.hpp"
+#include "matrix.hpp"
+#include "morton.hpp"
+#include "profile.hpp"
+#include "workspace.hpp"
+
+// Formulation of one recursion level: the classic 18-addition Strassen or
+// the 15-addition Strassen-Winograd.
+enum class variant { classic, winograd };
+
+// Storage the recursion runs on: the operands themselves, or copies in
+// Morton-ordered tiles (see morton.hpp) whose quadrants are contiguous at
+// every level.
+enum class layout { row_major, morton };
+
+// Tunables of the recursion.
+struct strassen_params {
+  // Operands of this size or smaller go to the blocked leaf kernel.
+  std::size_t leaf = 64;
+  variant formula = variant::classic;
+  layout storage = layout::row_major;
+  // Levels closer to the root than this spawn their products as tasks;
+  // deeper levels run sequentially inside the task that reached them.
+  unsigned task_depth = 3;
+  gemm_tiles tiles;
+  // Runs the task levels on this work-stealing pool instead of OpenMP tasks.
+  thread_pool* pool = nullptr;
+};
+
+// How a level brings odd dimensions to the even halves Strassen splits into.
+enum class split { even, peel, pad };
+
+// Peeling leaves the odd row of A, the odd column of B and the odd row and
+// column of C to rank-1 and matrix-vector updates, which are memory bound.
+// Padding runs them through the recursion instead but copies both operands
+// and the result. Both are O(n^2); the weights approximate the cost of one
+// peeled multiply-add and one copied element relative to a multiply-add done
+// inside the recursion.
+constexpr std::size_t peel_weight = 4;
+constexpr std::size_t pad_copy_weight = 2;
+
+inline split chooseSplit(std::size_t m, std::size_t k, std::size_t n) {
+  if (m % 2 == 0 && k % 2 == 0 && n % 2 == 0)
+    return split::even;
+
+  std::size_t m_lo = m & ~std::size_t{1}, m_hi = m_lo + 2 * (m % 2);
+  std::size_t k_lo = k & ~std::size_t{1}, k_hi = k_lo + 2 * (k % 2);
+  std::size_t n_lo = n & ~std::size_t{1}, n_hi = n_lo + 2 * (n % 2);
+  std::size_t core = m_lo * k_lo * n_lo;
+
+  std::size_t peel_cost = peel_weight * (m * k * n - core);
+  std::size_t pad_cost = (m_hi * k_hi * n_hi - core) +
+                         pad_copy_weight * (m_hi * k_hi + k_hi * n_hi + m * n);
+  return peel_cost <= pad_cost ? split::peel : split::pad;
+}
+
+// Tile grid of an m x k by k x n multiply in the Morton layout. levels is the
+// number of halvings the row-major recursion would make before reaching the
+// leaf; the tiles are the dimensions rounded up to a multiple of 2^levels and
+// divided by it, so the recursion on the grid ends exactly on whole tiles.
+struct morton_grid {
+  unsigned levels = 0;
+  std::size_t m_tile = 0, k_tile = 0, n_tile = 0;
+};
+
+inline morton_grid mortonGrid(std::size_t m, std::size_t k, std::size_t n,
+                              std::size_t leaf) {
+  morton_grid grid{0, m, k, n};
+  while (std::min({grid.m_tile, grid.k_tile, grid.n_tile}) > leaf) {
+    grid.m_tile = (grid.m_tile + 1) / 2;
+    grid.k_tile = (grid.k_tile + 1) / 2;
+    grid.n_tile = (grid.n_tile + 1) / 2;
+    ++grid.levels;
+  }
+  return grid;
+}
+
+// Per-thread scratch bytes of an m x k by k x n multiply: the deepest chain
+// of frames is, per level, the padded copies (if any) and the temporaries of
+// the node: for the classic formula the seven products plus the operand sums
+// of one child task, for Winograd S1..S4, T1..T4 and the three products that
+// do not live in C.
+template <typename T>
+std::size_t strassenScratch(std::size_t m, std::size_t k, std::size_t n,
+                            const strassen_params& params) {
+  if (params.storage == layout::morton) {
+    // The Morton copies live outside the arenas; the grid dimensions halve
+    // evenly down to the tiles.
+    auto grid = mortonGrid(m, k, n, params.leaf);
+    m = grid.m_tile << grid.levels;
+    k = grid.k_tile << grid.levels;
+    n = grid.n_tile << grid.levels;
+  }
+
+  std::size_t bytes = 0;
+  while (std::min({m, k, n}) > params.leaf) {
+    switch (chooseSplit(m, k, n)) {
+      case split::pad:
+        m += m % 2, k += k % 2, n += n % 2;
+        bytes += workspace::sliceBytes<T>(m, k) +
+                 workspace::sliceBytes<T>(k, n) +
+                 workspace::sliceBytes<T>(m, n);
+        break;
+      case split::peel:
+      case split::even:
+        break;
+    }
+    m >>= 1, k >>= 1, n >>= 1;
+    if (params.formula == variant::winograd)
+      bytes += 4 * workspace::sliceBytes<T>(m, k) +
+               4 * workspace::sliceBytes<T>(k, n) +
+               3 * workspace::sliceBytes<T>(m, n);
+    else
+      bytes += 7 * workspace::sliceBytes<T>(m, n) +
+               workspace::sliceBytes<T>(m, k) + workspace::sliceBytes<T>(k, n);
+  }
+  return bytes;
+}
+
+template <typename T>
+void algorithmStrassen(const_matrix_view<T> A, const_matrix_view<T> B,
+                       matrix_view<T> C, workspace& ws,
+                       const strassen_params& params, unsigned depth);
+
+template <typename T>
+void algorithmStrassen(const_morton_view<T> A, const_morton_view<T> B,
+                       morton_view<T> C, workspace& ws,
+                       const strassen_params& params, unsigned depth);
+
+// One Strassen level for operands with even dimensions. Operands and the
+// result are views into the caller's buffers: quadrants are taken in place
+// and C11..C22 are written straight into the quadrants of C. Temporaries come
+// from the arena of the thread running the current task.
+//
+// Above params.task_depth every product is a task that forms its own operand
+// sums, and each quadrant of C is a task that starts as soon as the products
+// it reads are done (on a thread_pool, once all of them are). Below it the
+// level runs without any task constructs.
+template <template <typename> class View, typename T>
+void classicStep(std::type_identity_t<View<const T>> A,
+                 std::type_identity_t<View<const T>> B, View<T> C, workspace& ws,
+                 const strassen_params& params, unsigned depth) {
+  auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+  auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+  auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+  auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+  auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+  auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+
+  // Recursive part of the algorithm.
+  workspace::frame products{ws.local()};
+  auto P1 = acquireLike(products, C11), P2 = acquireLike(products, C11);
+  auto P3 = acquireLike(products, C11), P4 = acquireLike(products, C11);
+  auto P5 = acquireLike(products, C11), P6 = acquireLike(products, C11);
+  auto P7 = acquireLike(products, C11);
+
+  auto product1 = [&] {
+    STRASSEN_PROFILE_TASK("P1", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(addInto(acquireLike(operands, A11), A11, A22),
+                      addInto(acquireLike(operands, B11), B11, B22), P1, ws,
+                      params, depth + 1);
+  };
+  auto product2 = [&] {
+    STRASSEN_PROFILE_TASK("P2", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(addInto(acquireLike(operands, A11), A21, A22), B11, P2,
+                      ws, params, depth + 1);
+  };
+  auto product3 = [&] {
+    STRASSEN_PROFILE_TASK("P3", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(A11, subtractInto(acquireLike(operands, B11), B12, B22),
+                      P3, ws, params, depth + 1);
+  };
+  auto product4 = [&] {
+    STRASSEN_PROFILE_TASK("P4", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(A22, subtractInto(acquireLike(operands, B11), B21, B11),
+                      P4, ws, params, depth + 1);
+  };
+  auto product5 = [&] {
+    STRASSEN_PROFILE_TASK("P5", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(addInto(acquireLike(operands, A11), A11, A12), B22, P5,
+                      ws, params, depth + 1);
+  };
+  auto product6 = [&] {
+    STRASSEN_PROFILE_TASK("P6", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(subtractInto(acquireLike(operands, A11), A21, A11),
+                      addInto(acquireLike(operands, B11), B11, B12), P6, ws,
+                      params, depth + 1);
+  };
+  auto product7 = [&] {
+    STRASSEN_PROFILE_TASK("P7", depth);
+    workspace::frame operands{ws.local()};
+    algorithmStrassen(subtractInto(acquireLike(operands, A11), A12, A22),
+                      addInto(acquireLike(operands, B11), B21, B22), P7, ws,
+                      params, depth + 1);
+  };
+
+  if (depth >= params.task_depth) {
+    product1();
+    product2();
+    product3();
+    product4();
+    product5();
+    product6();
+    product7();
+
+    // Calculating the result submatrices straight into the quadrants of C.
+    STRASSEN_PROFILE_SCOPE(combine);
+    using W = kernel_t<T>;
+    for (std::size_t i = 0; i < C11.nrows(); ++i) {
+      for (std::size_t j = 0; j < C11.ncols(); ++j) {
+        W p1 = P1[i][j], p2 = P2[i][j], p3 = P3[i][j], p4 = P4[i][j];
+        W p5 = P5[i][j], p6 = P6[i][j], p7 = P7[i][j];
+        C11[i][j] = T(p1 + p4 - p5 + p7);
+        C12[i][j] = T(p3 + p5);
+        C21[i][j] = T(p2 + p4);
+        C22[i][j] = T(p1 - p2 + p3 + p6);
+      }
+    }
+    return;
+  }
+
+  if (params.pool) {
+    // Fork-join: the quadrants of C start once all seven products are done.
+    STRASSEN_PROFILE_COUNT(tasks, 11);
+    task_group product_tasks{*params.pool};
+    product_tasks.spawn(depth, product1);
+    product_tasks.spawn(depth, product2);
+    product_tasks.spawn(depth, product3);
+    product_tasks.spawn(depth, product4);
+    product_tasks.spawn(depth, product5);
+    product_tasks.spawn(depth, product6);
+    product_tasks.spawn(depth, product7);
+    {
+      STRASSEN_PROFILE_SCOPE(wait);
+      product_tasks.wait(depth);
+    }
+
+    task_group quadrant_tasks{*params.pool};
+    quadrant_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_LEVEL(depth);
+      STRASSEN_PROFILE_SCOPE(combine);
+      assign(C11, P1 + P4 - P5 + P7);
+    });
+    quadrant_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_LEVEL(depth);
+      STRASSEN_PROFILE_SCOPE(combine);
+      assign(C12, P3 + P5);
+    });
+    quadrant_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_LEVEL(depth);
+      STRASSEN_PROFILE_SCOPE(combine);
+      assign(C21, P2 + P4);
+    });
+    quadrant_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_LEVEL(depth);
+      STRASSEN_PROFILE_SCOPE(combine);
+      assign(C22, P1 - P2 + P3 + P6);
+    });
+    STRASSEN_PROFILE_SCOPE(wait);
+    quadrant_tasks.wait(depth);
+    return;
+  }
+
+  STRASSEN_PROFILE_COUNT(tasks, 11);
+  #pragma omp task depend(out: P1)
+    product1();
+  #pragma omp task depend(out: P2)
+    product2();
+  #pragma omp task depend(out: P3)
+    product3();
+  #pragma omp task depend(out: P4)
+    product4();
+  #pragma omp task depend(out: P5)
+    product5();
+  #pragma omp task depend(out: P6)
+    product6();
+  #pragma omp task depend(out: P7)
+    product7();
+
+  #pragma omp task depend(in: P1, P4, P5, P7)
+  {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(combine);
+    assign(C11, P1 + P4 - P5 + P7);
+  }
+  #pragma omp task depend(in: P3, P5)
+  {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(combine);
+    assign(C12, P3 + P5);
+  }
+  #pragma omp task depend(in: P2, P4)
+  {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(combine);
+    assign(C21, P2 + P4);
+  }
+  #pragma omp task depend(in: P1, P2, P3, P6)
+  {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(combine);
+    assign(C22, P1 - P2 + P3 + P6);
+  }
+
+  STRASSEN_PROFILE_SCOPE(wait);
+  #pragma omp taskwait
+}
+
+// One Strassen-Winograd level for operands with even dimensions:
+//   S1 = A21 + A22  S2 = S1 - A11  S3 = A11 - A21  S4 = A12 - S2
+//   T1 = B12 - B11  T2 = B22 - T1  T3 = B22 - B12  T4 = T2 - B21
+//   P1 = A11 B11  P2 = A12 B21  P3 = S4 B22  P4 = A22 T4
+//   P5 = S1 T1    P6 = S2 T2    P7 = S3 T3
+//   C11 = P1 + P2         C12 = P1 + P6 + P5 + P3
+//   C21 = P1 + P6 + P7 - P4  C22 = P1 + P6 + P7 + P5
+// Each group of additions is one fused pass that reads its inputs and writes
+// its outputs once; the shared partial sums U2 = P1 + P6 and U3 = U2 + P7
+// stay in registers. P1, P5, P6 and P7 are computed in place in the
+// quadrants of C, so a level needs only eleven quadrant-sized temporaries.
+//
+// Above params.task_depth the S and T passes are tasks of their own, and
+// P1 and P2, which need neither, start right away alongside them.
+template <template <typename> class View, typename T>
+void winogradStep(std::type_identity_t<View<const T>> A,
+                  std::type_identity_t<View<const T>> B, View<T> C, workspace& ws,
+                  const strassen_params& params, unsigned depth) {
+  auto A11 = A.quadrant(0, 0), A12 = A.quadrant(0, 1);
+  auto A21 = A.quadrant(1, 0), A22 = A.quadrant(1, 1);
+  auto B11 = B.quadrant(0, 0), B12 = B.quadrant(0, 1);
+  auto B21 = B.quadrant(1, 0), B22 = B.quadrant(1, 1);
+  auto C11 = C.quadrant(0, 0), C12 = C.quadrant(0, 1);
+  auto C21 = C.quadrant(1, 0), C22 = C.quadrant(1, 1);
+
+  workspace::frame temporaries{ws.local()};
+  auto S1 = acquireLike(temporaries, A11), S2 = acquireLike(temporaries, A11);
+  auto S3 = acquireLike(temporaries, A11), S4 = acquireLike(temporaries, A11);
+  auto T1 = acquireLike(temporaries, B11), T2 = acquireLike(temporaries, B11);
+  auto T3 = acquireLike(temporaries, B11), T4 = acquireLike(temporaries, B11);
+  auto P2 = acquireLike(temporaries, C11), P3 = acquireLike(temporaries, C11);
+  auto P4 = acquireLike(temporaries, C11);
+
+  using W = kernel_t<T>;
+  auto sPass = [&] {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(additions);
+    for (std::size_t i = 0; i < A11.nrows(); ++i) {
+      const T *a11 = A11[i], *a12 = A12[i], *a21 = A21[i], *a22 = A22[i];
+      T *s1 = S1[i], *s2 = S2[i], *s3 = S3[i], *s4 = S4[i];
+#pragma omp simd
+      for (std::size_t j = 0; j < A11.ncols(); ++j) {
+        W sum = W(a21[j]) + W(a22[j]);
+        W diff = sum - W(a11[j]);
+        s1[j] = T(sum);
+        s2[j] = T(diff);
+        s3[j] = T(W(a11[j]) - W(a21[j]));
+        s4[j] = T(W(a12[j]) - diff);
+      }
+    }
+  };
+
+  auto tPass = [&] {
+    STRASSEN_PROFILE_LEVEL(depth);
+    STRASSEN_PROFILE_SCOPE(additions);
+    for (std::size_t i = 0; i < B11.nrows(); ++i) {
+      const T *b11 = B11[i], *b12 = B12[i], *b21 = B21[i], *b22 = B22[i];
+      T *t1 = T1[i], *t2 = T2[i], *t3 = T3[i], *t4 = T4[i];
+#pragma omp simd
+      for (std::size_t j = 0; j < B11.ncols(); ++j) {
+        W diff = W(b12[j]) - W(b11[j]);
+        W rest = W(b22[j]) - diff;
+        t1[j] = T(diff);
+        t2[j] = T(rest);
+        t3[j] = T(W(b22[j]) - W(b12[j]));
+        t4[j] = T(rest - W(b21[j]));
+      }
+    }
+  };
+
+  if (depth >= params.task_depth) {
+    sPass();
+    tPass();
+    algorithmStrassen(A11, B11, C11, ws, params, depth + 1);
+    algorithmStrassen(A12, B21, P2, ws, params, depth + 1);
+    algorithmStrassen(S4, B22, P3, ws, params, depth + 1);
+    algorithmStrassen(A22, T4, P4, ws, params, depth + 1);
+    algorithmStrassen(S1, T1, C12, ws, params, depth + 1);
+    algorithmStrassen(S2, T2, C21, ws, params, depth + 1);
+    algorithmStrassen(S3, T3, C22, ws, params, depth + 1);
+  } else if (params.pool) {
+    // P1 and P2 go first; this worker forms S and T while they are stolen.
+    STRASSEN_PROFILE_COUNT(tasks, 7);
+    task_group product_tasks{*params.pool};
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P1", depth);
+      algorithmStrassen(A11, B11, C11, ws, params, depth + 1);
+    });
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P2", depth);
+      algorithmStrassen(A12, B21, P2, ws, params, depth + 1);
+    });
+    sPass();
+    tPass();
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P3", depth);
+      algorithmStrassen(S4, B22, P3, ws, params, depth + 1);
+    });
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P4", depth);
+      algorithmStrassen(A22, T4, P4, ws, params, depth + 1);
+    });
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P5", depth);
+      algorithmStrassen(S1, T1, C12, ws, params, depth + 1);
+    });
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P6", depth);
+      algorithmStrassen(S2, T2, C21, ws, params, depth + 1);
+    });
+    product_tasks.spawn(depth, [&] {
+      STRASSEN_PROFILE_TASK("P7", depth);
+      algorithmStrassen(S3, T3, C22, ws, params, depth + 1);
+    });
+    STRASSEN_PROFILE_SCOPE(wait);
+    product_tasks.wait(depth);
+  } else {
+    // Recursive part of the algorithm.
+    STRASSEN_PROFILE_COUNT(tasks, 9);
+    #pragma omp task depend(out: S1)
+      sPass();
+    #pragma omp task depend(out: T1)
+      tPass();
+
+    #pragma omp task shared(ws, params)
+    {
+      STRASSEN_PROFILE_TASK("P1", depth);
+      algorithmStrassen(A11, B11, C11, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params)
+    {
+      STRASSEN_PROFILE_TASK("P2", depth);
+      algorithmStrassen(A12, B21, P2, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params) depend(in: S1)
+    {
+      STRASSEN_PROFILE_TASK("P3", depth);
+      algorithmStrassen(S4, B22, P3, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params) depend(in: T1)
+    {
+      STRASSEN_PROFILE_TASK("P4", depth);
+      algorithmStrassen(A22, T4, P4, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params) depend(in: S1, T1)
+    {
+      STRASSEN_PROFILE_TASK("P5", depth);
+      algorithmStrassen(S1, T1, C12, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params) depend(in: S1, T1)
+    {
+      STRASSEN_PROFILE_TASK("P6", depth);
+      algorithmStrassen(S2, T2, C21, ws, params, depth + 1);
+    }
+    #pragma omp task shared(ws, params) depend(in: S1, T1)
+    {
+      STRASSEN_PROFILE_TASK("P7", depth);
+      algorithmStrassen(S3, T3, C22, ws, params, depth + 1);
+    }
+
+    STRASSEN_PROFILE_SCOPE(wait);
+    #pragma omp taskwait
+  }
+
+  STRASSEN_PROFILE_SCOPE(combine);
+  for (std::size_t i = 0; i < C11.nrows(); ++i) {
+    T *c11 = C11[i], *c12 = C12[i], *c21 = C21[i], *c22 = C22[i];
+    const T *p2 = P2[i], *p3 = P3[i], *p4 = P4[i];
+#pragma omp simd
+    for (std::size_t j = 0; j < C11.ncols(); ++j) {
+      W p1 = c11[j], p5 = c12[j], p6 = c21[j], p7 = c22[j];
+      W u2 = p1 + p6;
+      W u3 = u2 + p7;
+      c11[j] = T(p1 + W(p2[j]));
+      c12[j] = T(u2 + p5 + W(p3[j]));
+      c21[j] = T(u3 - W(p4[j]));
+      c22[j] = T(u3 + p5);
+    }
+  }
+}
+
+template <template <typename> class View, typename T>
+void strassenStep(std::type_identity_t<View<const T>> A,
+                  std::type_identity_t<View<const T>> B, View<T> C, workspace& ws,
+                  const strassen_params& params, unsigned depth) {
+  if (params.formula == variant::winograd)
+    winogradStep<View, T>(A, B, C, ws, params, depth);
+  else
+    classicStep<View, T>(A, B, C, ws, params, depth);
+}
+
+// Strassen on the even core, then the odd row/column of C from the peeled
+// row of A and column of B.
+template <typename T>
+void peelStep(const_matrix_view<T> A, const_matrix_view<T> B,
+              matrix_view<T> C, workspace& ws, const strassen_params& params,
+              unsigned depth) {
+  std::size_t m = C.nrows(), k = A.ncols(), n = C.ncols();
+  std::size_t m_lo = m & ~std::size_t{1};
+  std::size_t k_lo = k & ~std::size_t{1};
+  std::size_t n_lo = n & ~std::size_t{1};
+
+  auto core = C.block(0, 0, m_lo, n_lo);
+  strassenStep(A.block(0, 0, m_lo, k_lo), B.block(0, 0, k_lo, n_lo), core, ws,
+               params, depth);
+
+  // The peeled updates are plain multiply-adds, charged to the leaf phase.
+  STRASSEN_PROFILE_SCOPE(leaf);
+  using W = kernel_t<T>;
+  if (k != k_lo) {
+    for (std::size_t i = 0; i < m_lo; ++i) {
+      W a = A[i][k_lo];
+      const T* b = B[k_lo];
+      T* c = core[i];
+      for (std::size_t j = 0; j < n_lo; ++j)
+        c[j] = T(W(c[j]) + a * W(b[j]));
+    }
+  }
+  if (n != n_lo) {
+    // Gather the odd column of B in chunks so that the dot products with the
+    // rows of A run over contiguous memory.
+    constexpr std::size_t chunk = 256;
+    T column[chunk];
+    for (std::size_t i = 0; i < m_lo; ++i)
+      C[i][n_lo] = T{};
+    for (std::size_t p = 0; p < k; p += chunk) {
+      std::size_t len = std::min(chunk, k - p);
+      for (std::size_t q = 0; q < len; ++q)
+        column[q] = B[p + q][n_lo];
+      for (std::size_t i = 0; i < m_lo; ++i) {
+        const T* a = A[i] + p;
+        W dot{};
+#pragma omp simd reduction(+ : dot)
+        for (std::size_t q = 0; q < len; ++q)
+          dot += W(a[q]) * W(column[q]);
+        C[i][n_lo] = T(W(C[i][n_lo]) + dot);
+      }
+    }
+  }
+  if (m != m_lo)
+    multiplyBlocked(C.block(m_lo, 0, 1, n), A.block(m_lo, 0, 1, k), B,
+                    params.tiles);
+}
+
+template <typename T>
+void copyPadded(matrix_view<T> dest, const_matrix_view<T> src) {
+  STRASSEN_PROFILE_COUNT(copied_bytes,
+                         dest.nrows() * dest.ncols() * sizeof(T));
+  for (std::size_t i = 0; i < dest.nrows(); ++i) {
+    if (i < src.nrows()) {
+      std::copy(src[i], src[i] + src.ncols(), dest[i]);
+      std::fill(dest[i] + src.ncols(), dest[i] + dest.ncols(), T{});
+    } else {
+      std::fill(dest[i], dest[i] + dest.ncols(), T{});
+    }
+  }
+}
+
+// Strassen on copies of the operands padded with a zero row/column up to the
+// next even dimensions.
+template <typename T>
+void padStep(const_matrix_view<T> A, const_matrix_view<T> B,
+             matrix_view<T> C, workspace& ws, const strassen_params& params,
+             unsigned depth) {
+  std::size_t m = C.nrows(), k = A.ncols(), n = C.ncols();
+  workspace::frame padded{ws.local()};
+  auto Ap = padded.acquire<T>(m + m % 2, k + k % 2);
+  auto Bp = padded.acquire<T>(k + k % 2, n + n % 2);
+  auto Cp = padded.acquire<T>(m + m % 2, n + n % 2);
+  {
+    STRASSEN_PROFILE_SCOPE(copies);
+    copyPadded(Ap, A);
+    copyPadded(Bp, B);
+  }
+
+  strassenStep(Ap, Bp, Cp, ws, params, depth);
+
+  STRASSEN_PROFILE_SCOPE(copies);
+  STRASSEN_PROFILE_COUNT(copied_bytes, m * n * sizeof(T));
+  for (std::size_t i = 0; i < m; ++i)
+    std::copy(Cp[i], Cp[i] + n, C[i]);
+}
+
+// C = A * B for an m x k matrix A and a k x n matrix B of any dimensions.
+// depth is the recursion level of this call, 0 at the top.
+template <typename T>
+void algorithmStrassen(const_matrix_view<T> A, const_matrix_view<T> B,
+                       matrix_view<T> C, workspace& ws,
+                       const strassen_params& params, unsigned depth) {
+  assert(A.ncols() == B.nrows());
+  assert(C.nrows() == A.nrows() && C.ncols() == B.ncols());
+
+  STRASSEN_PROFILE_LEVEL(depth);
+  std::size_t m = A.nrows(), k = A.ncols(), n = B.ncols();
+  // Below the crossover plain blocked multiplication beats the extra
+  // additions of another Strassen level.
+  if (std::min({m, k, n}) <= params.leaf) {
+    STRASSEN_PROFILE_SCOPE(leaf);
+    multiplyBlocked(C, A, B, params.tiles);
+    return;
+  }
+
+  switch (chooseSplit(m, k, n)) {
+    case split::even:
+      strassenStep(A, B, C, ws, params, depth);
+      break;
+    case split::peel:
+      peelStep(A, B, C, ws, params, depth);
+      break;
+    case split::pad:
+      padStep(A, B, C, ws, params, depth);
+      break;
+  }
+}
+
+// C = A * B on Morton grids of the same number of levels, whose tiles are
+// the leaves of the recursion.
+template <typename T>
+void algorithmStrassen(const_morton_view<T> A, const_morton_view<T> B,
+                       morton_view<T> C, workspace& ws,
+                       const strassen_params& params, unsigned depth) {
+  assert(A.levels() == C.levels() && B.levels() == C.levels());
+  assert(A.tileCols() == B.tileRows());
+  assert(C.tileRows() == A.tileRows() && C.tileCols() == B.tileCols());
+
+  STRASSEN_PROFILE_LEVEL(depth);
+  if (C.levels() == 0) {
+    STRASSEN_PROFILE_SCOPE(leaf);
+    multiplyBlocked(C.tile(0, 0), A.tile(0, 0), B.tile(0, 0), params.tiles);
+    return;
+  }
+  strassenStep(A, B, C, ws, params, depth);
+}
+
+// C = A * B into a result the caller owns, e.g. a memory-mapped file, in the
+// storage params ask for.
+template <typename T>
+void algorithmStrassen(const_matrix_view<T> A, const_matrix_view<T> B,
+                       matrix_view<T> C, workspace& ws,
+                       const strassen_params& params) {
+  if (A.ncols() != B.nrows() || C.nrows() != A.nrows() ||
+      C.ncols() != B.ncols())
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  if (params.storage == layout::row_major) {
+    algorithmStrassen(A, B, C, ws, params, 0);
+    return;
+  }
+
+  // Convert at the boundary; the recursion then only touches whole tiles and
+  // contiguous quadrants.
+  auto grid = mortonGrid(A.nrows(), A.ncols(), B.ncols(), params.leaf);
+  morton_matrix<T> Am{grid.levels, grid.m_tile, grid.k_tile};
+  morton_matrix<T> Bm{grid.levels, grid.k_tile, grid.n_tile};
+  morton_matrix<T> Cm{grid.levels, grid.m_tile, grid.n_tile};
+  {
+    STRASSEN_PROFILE_SCOPE(copies);
+    toMorton(Am.view(), A);
+    toMorton(Bm.view(), B);
+  }
+  algorithmStrassen(Am.view(), Bm.view(), Cm.view(), ws, params, 0);
+  STRASSEN_PROFILE_SCOPE(copies);
+  fromMorton(C, Cm.view());
+}
+
+template <typename T>
+matrix<T> algorithmStrassen(const matrix<T>& A, const matrix<T>& B,
+                            workspace& ws, const strassen_params& params) {
+  if (A.ncols() != B.nrows())
+    throw std::runtime_error("Unsuitable matrix sizes");
+
+  // Left uninitialized: every element is written by the recursion, so its
+  // pages are first touched by the threads computing them.
+  matrix<T> C{A.nrows(), B.ncols(), uninitialized};
+  algorithmStrassen(A.view(), B.view(), C.view(), ws, params);
+  return C;
+}
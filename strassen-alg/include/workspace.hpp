@@ -0,0 +1,151 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "executor.hpp"
+#include "matrix.hpp"
+#include "profile.hpp"
+
+// Scratch memory for the Strassen recursion, reserved once per multiply.
+//
+// Every thread owns a stack-like arena carved out of a single allocation.
+// A task takes its temporaries from the arena of the thread executing it and
+// gives them back in LIFO order when it finishes. Tied tasks only nest on a
+// thread as descendants of each other, so the live frames of one arena always
+// form a single root-to-leaf path of the recursion; thread_pool keeps the
+// same invariant by depth. The caller sizes the arenas for the deepest such
+// path.
+//
+// The allocation is not zeroed, so an arena's pages go to the NUMA node of
+// the thread that first writes them. touch() lets each thread do that before
+// the multiply instead of page-faulting inside it.
+class workspace {
+  static constexpr std::size_t alignment = 64;
+
+  static std::size_t alignUp(std::size_t bytes) {
+    return (bytes + alignment - 1) / alignment * alignment;
+  }
+
+ public:
+  // Arena bytes taken by one rows x cols temporary of type T.
+  template <typename T>
+  static std::size_t sliceBytes(std::size_t rows, std::size_t cols) {
+    return alignUp(rows * cols * sizeof(T));
+  }
+
+  class arena {
+    std::byte* base = nullptr;
+    std::size_t capacity = 0;
+    std::size_t top = 0;
+    std::size_t peak = 0;
+
+   public:
+    arena() = default;
+    arena(std::byte* base, std::size_t capacity)
+        : base{base}, capacity{capacity} {}
+
+    template <typename T>
+    matrix_view<T> acquire(std::size_t rows, std::size_t cols) {
+      std::size_t bytes = sliceBytes<T>(rows, cols);
+      if (top + bytes > capacity)
+        throw std::runtime_error("Workspace arena exhausted");
+
+      STRASSEN_PROFILE_COUNT(allocations, 1);
+      STRASSEN_PROFILE_COUNT(allocated_bytes, bytes);
+      auto* ptr = reinterpret_cast<T*>(base + top);
+      top += bytes;
+      peak = std::max(peak, top);
+      return matrix_view<T>{ptr, rows, cols, cols};
+    }
+
+    std::size_t mark() const { return top; }
+    void release(std::size_t mark) { top = mark; }
+
+    std::size_t peakBytes() const { return peak; }
+
+    void touch() {
+      if (capacity != 0)
+        std::memset(base, 0, capacity);
+    }
+  };
+
+  // Temporaries taken through a frame are returned to the arena when the
+  // frame goes out of scope.
+  class frame {
+    arena& owner;
+    std::size_t saved;
+
+   public:
+    explicit frame(arena& owner) : owner{owner}, saved{owner.mark()} {}
+    frame(const frame&) = delete;
+    frame& operator=(const frame&) = delete;
+    ~frame() { owner.release(saved); }
+
+    template <typename T>
+    matrix_view<T> acquire(std::size_t rows, std::size_t cols) {
+      return owner.acquire<T>(rows, cols);
+    }
+  };
+
+  static std::size_t defaultThreads() {
+#ifdef _OPENMP
+    return omp_get_max_threads();
+#else
+    return 1;
+#endif
+  }
+
+  // One arena of per_thread_bytes for each of the threads of the executor.
+  explicit workspace(std::size_t per_thread_bytes,
+                     std::size_t threads = defaultThreads())
+      : per_thread{alignUp(per_thread_bytes)}, storage{nullptr, &std::free} {
+    if (per_thread != 0) {
+      storage.reset(static_cast<std::byte*>(
+          std::aligned_alloc(alignment, per_thread * threads)));
+      if (!storage)
+        throw std::bad_alloc();
+    }
+
+    arenas.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i)
+      arenas.emplace_back(storage.get() + i * per_thread, per_thread);
+  }
+
+  arena& local() { return arenas[executorThread()]; }
+
+  // Writes the arena of executor thread `thread`; call it from that thread.
+  void touch(std::size_t thread) { arenas[thread].touch(); }
+
+  std::size_t reservedBytes() const { return per_thread * arenas.size(); }
+
+  std::size_t peakBytes() const {
+    std::size_t bytes = 0;
+    for (const auto& a : arenas)
+      bytes += a.peakBytes();
+    return bytes;
+  }
+
+ private:
+  std::size_t per_thread;
+  std::unique_ptr<std::byte, decltype(&std::free)> storage;
+  std::vector<arena> arenas;
+};
+
+// Scratch view of the same shape as v.
+template <typename T>
+matrix_view<std::remove_const_t<T>> acquireLike(workspace::frame& frame,
+                                                const basic_matrix_view<T>& v) {
+  return frame.acquire<std::remove_const_t<T>>(v.nrows(), v.ncols());
+}
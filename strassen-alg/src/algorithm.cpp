@@ -1,10 +1,23 @@
-#include <chrono>
 #include <algorithm>
-#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <cstdint>
+#include <filesystem>
 #include <iostream>
-#include <bit>
+#include <string>
 #include <omp.h>
+#include <optional>
+#include <vector>
+#include "autotune.hpp"
+#include "chain.hpp"
+#include "executor.hpp"
 #include "matrix.hpp"
+#include "matrix_file.hpp"
+#include "modular.hpp"
+#include "out_of_core.hpp"
+#include "profile.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
 
 #include <boost/lexical_cast.hpp>
 #include <boost/program_options.hpp>
@@ -12,101 +25,399 @@
 
 namespace po = boost::program_options;
 
-static void fillSubmatrix(matrix& dest, const matrix& src,
-                          std::size_t row_offset, std::size_t col_offset) {
-  auto dest_rows = dest.getProxyRows();
-  std::for_each(dest_rows.begin(), dest_rows.end(), [&](auto& dest_row) {
-    auto src_row = src[row_offset++];
-    std::copy(src_row.begin() + col_offset,
-              src_row.begin() + col_offset + dest.ncols(), dest_row.begin());
-  });
+// Which runtime executes the task levels of the recursion.
+struct executor_config {
+  bool pool = false;
+  unsigned threads = 0;
+  bool pin = false;
+};
+
+// Input and output files of a run. Without inputs the operands are matrices
+// of ones; without an output the result is discarded. With a memory budget
+// the products above it run out of core, on scratch files in scratch_dir.
+struct io_config {
+  const mapped_file* a = nullptr;
+  const mapped_file* b = nullptr;
+  std::string out;
+  std::size_t memory_budget = 0;
+  std::string scratch_dir;
+};
+
+// Reports of builds with STRASSEN_PROFILE: the per-level and per-thread
+// summary, and a Chrome trace of the run.
+struct profile_config {
+  bool summary = false;
+  std::string trace;
+};
+
+// Rows [first, last) of M set to ones.
+template <typename T>
+static void fillOnes(matrix_view<T> M, std::size_t first, std::size_t last) {
+  for (std::size_t i = first; i < last; ++i)
+    std::fill(M[i], M[i] + M.ncols(), T{1});
 }
 
-// I refused the idea of removing an explicit loop, because this will
-// increase the number of nested loops from 1 to 4.
-static void combineSubmatrix(matrix& dest, const matrix& src11,
-                             const matrix& src12, const matrix& src21,
-                             const matrix& src22) {
-  std::size_t offset = src11.nrows();
-  for (std::size_t i = 0; i < offset; ++i) {
-    for (std::size_t j = 0; j < offset; ++j) {
-      dest[i][j] = src11[i][j];
-      dest[i][j + offset] = src12[i][j];
-      dest[i + offset][j] = src21[i][j];
-      dest[i + offset][j + offset] = src22[i][j];
-    }
+// --autotune: measure the tunables for this machine before the run and
+// store them under key in file, where later runs pick them up.
+struct tune_config {
+  bool autotune = false;
+  std::string file;
+  std::string key;
+  // --leaf and --task-depth given on the command line win over the tuning.
+  bool keep_leaf = false;
+  bool keep_task_depth = false;
+};
+
+// Multiplies m x k and k x n matrices with elements of type T and reports
+// the time and the scratch memory of the run.
+//
+// Input files are used in place through their mappings, and the result is
+// written straight into the mapping of the output file. Generated operands
+// and the arenas are allocated uninitialized and first written by the
+// threads of the executor, the operands in bands of rows, so their pages
+// spread over the NUMA nodes those threads run on.
+template <typename T>
+static void run(std::size_t m, std::size_t k, std::size_t n,
+                strassen_params params, const executor_config& exec,
+                const io_config& io, const profile_config& prof,
+                const tune_config& tune) {
+  if (tune.autotune) {
+    std::optional<thread_pool> pool;
+    if (exec.pool)
+      params.pool = &pool.emplace(exec.threads, exec.pin);
+    tuning best = autotune<T>(params, exec.threads);
+    params.pool = nullptr;
+    best.applyTo(params, tune.keep_leaf, tune.keep_task_depth);
+    saveTuning(tune.file, tune.key, best);
+    std::cout << "Tuned: leaf " << best.leaf << ", task depth "
+              << best.task_depth << ", tiles " << best.tiles.mc << " x "
+              << best.tiles.kc << " x " << best.tiles.nc << " (saved to "
+              << tune.file << ")" << std::endl;
+    if (tune.keep_leaf || tune.keep_task_depth)
+      std::cout << "Running with leaf " << params.leaf << ", task depth "
+                << params.task_depth << ": --leaf and --task-depth win"
+                << std::endl;
+  }
+
+  matrix<T> A_ones, B_ones;
+  const_matrix_view<T> A, B;
+  if (io.a) {
+    A = mappedMatrix<T>(*io.a);
+    B = mappedMatrix<T>(*io.b);
+  } else {
+    A_ones = matrix<T>{m, k, uninitialized};
+    B_ones = matrix<T>{k, n, uninitialized};
+    A = A_ones.view();
+    B = B_ones.view();
   }
-}
 
-static matrix algorithmStrassen(const matrix& A, const matrix& B) {
-  assert(A.isSquare() && B.isSquare());
-  assert(A.nrows() == B.nrows());
-  assert(std::popcount(A.nrows()) == 1 && std::popcount(B.nrows()) == 1);
+  mapped_file out_file;
+  matrix<T> C_data;
+  matrix_view<T> C;
+  if (!io.out.empty()) {
+    out_file = createMatrixFile<T>(io.out, m, n);
+    C = createdMatrix<T>(out_file);
+  } else {
+    C_data = matrix<T>{m, n, uninitialized};
+    C = C_data.view();
+  }
+
+  std::size_t scratch = strassenScratch<T>(m, k, n, params);
+  std::chrono::duration<double, std::milli> elapsed;
+  std::size_t peak = 0, reserved = 0, scratch_files = 0;
 
-  std::size_t size = A.nrows();
-  // Use the usual multiplication for a small matrix size.
-  if (size <= 2)
-    return A * B;
+  if (io.memory_budget) {
+    std::optional<thread_pool> pool;
+    if (exec.pool)
+      params.pool = &pool.emplace(exec.threads, exec.pin);
+    if (!io.a) {
+#pragma omp parallel for schedule(static) num_threads(exec.threads)
+      for (std::size_t i = 0; i < std::max(m, k); ++i) {
+        if (i < m)
+          fillOnes(A_ones.view(), i, i + 1);
+        if (i < k)
+          fillOnes(B_ones.view(), i, i + 1);
+      }
+    }
 
-  std::size_t n = size >> 1;
-  matrix A11{n, n}, A12{n, n}, A21{n, n}, A22{n, n};
-  matrix B11{n, n}, B12{n, n}, B21{n, n}, B22{n, n};
+#ifdef STRASSEN_PROFILE
+    profile::registry::instance().reset(!prof.trace.empty());
+#endif
+    auto start = std::chrono::high_resolution_clock::now();
+    auto stats = multiplyOutOfCore(
+        A, B, C, params,
+        out_of_core_params{io.memory_budget, io.scratch_dir, exec.threads});
+    auto finish = std::chrono::high_resolution_clock::now();
+    elapsed = finish - start;
+    peak = reserved = stats.arena_bytes;
+    scratch_files = stats.scratch_file_bytes;
+  } else if (exec.pool) {
+    thread_pool pool{exec.threads, exec.pin};
+    params.pool = &pool;
+    workspace ws{scratch, pool.size()};
+    pool.forEachWorker([&](unsigned worker) {
+      ws.touch(worker);
+      if (io.a)
+        return;
+      fillOnes(A_ones.view(), m * worker / pool.size(),
+               m * (worker + 1) / pool.size());
+      fillOnes(B_ones.view(), k * worker / pool.size(),
+               k * (worker + 1) / pool.size());
+    });
 
-  fillSubmatrix(A11, A, 0, 0);
-  fillSubmatrix(A12, A, 0, n);
-  fillSubmatrix(A21, A, n, 0);
-  fillSubmatrix(A22, A, n, n);
+#ifdef STRASSEN_PROFILE
+    profile::registry::instance().reset(!prof.trace.empty());
+#endif
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.run([&] { algorithmStrassen(A, B, C, ws, params); });
+    auto finish = std::chrono::high_resolution_clock::now();
+    elapsed = finish - start;
+    peak = ws.peakBytes();
+    reserved = ws.reservedBytes();
+  } else {
+    workspace ws{scratch, exec.threads};
+    bool generated = !io.a;
+#pragma omp parallel num_threads(exec.threads)
+{
+    ws.touch(executorThread());
+  #pragma omp for schedule(static) nowait
+    for (std::size_t i = 0; i < (generated ? m : 0); ++i)
+      fillOnes(A_ones.view(), i, i + 1);
+  #pragma omp for schedule(static)
+    for (std::size_t i = 0; i < (generated ? k : 0); ++i)
+      fillOnes(B_ones.view(), i, i + 1);
+}
 
-  fillSubmatrix(B11, B, 0, 0);
-  fillSubmatrix(B12, B, 0, n);
-  fillSubmatrix(B21, B, n, 0);
-  fillSubmatrix(B22, B, n, n);
+#ifdef STRASSEN_PROFILE
+    profile::registry::instance().reset(!prof.trace.empty());
+#endif
+    auto start = std::chrono::high_resolution_clock::now();
+#pragma omp parallel shared(A, B, C) num_threads(exec.threads)
+{
+  #pragma omp single nowait 
+		algorithmStrassen(A, B, C, ws, params);
+}
+    auto  finish = std::chrono::high_resolution_clock::now();
+    elapsed = finish - start;
+    peak = ws.peakBytes();
+    reserved = ws.reservedBytes();
+  }
 
-  // Recursive part of the algorithm.
-  matrix P1{}, P2{}, P3{}, P4{}, P5{}, P6{}, P7{};
+  std::cout << "Calculation took " << elapsed.count() << "ms to run"
+            << std::endl;
+  std::cout << "Scratch memory: " << peak << " bytes peak, " << reserved
+            << " bytes reserved" << std::endl;
+  if (io.memory_budget)
+    std::cout << "Scratch files: " << scratch_files << " bytes peak"
+              << std::endl;
 
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P1 = algorithmStrassen(A11 + A22, B11 + B22);
+#ifdef STRASSEN_PROFILE
+  if (prof.summary)
+    profile::registry::instance().printSummary(std::cout);
+  if (!prof.trace.empty()) {
+    std::ofstream os{prof.trace};
+    profile::registry::instance().writeTrace(os);
+  }
+#else
+  static_cast<void>(prof);
+#endif
+}
 
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P2 = algorithmStrassen(A21 + A22, B11);
-  
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P3 = algorithmStrassen(A11, B12 - B22);
-  
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P4 = algorithmStrassen(A22, B21 - B11);
+// --chain and --pow: a product of several matrices or a power of a square
+// one instead of a single product. With check the result is compared with
+// repeated operator*.
+struct chain_config {
+  std::vector<std::size_t> dims;
+  std::optional<unsigned long long> power;
+  bool check = false;
+};
 
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P5 = algorithmStrassen(A11 + A12, B22);
+// Entry (i, j) of factor f: small integers, so every type computes the
+// products exactly as long as they do not overflow.
+template <typename T>
+static T chainElement(std::size_t f, std::size_t i, std::size_t j) {
+  return T(static_cast<int>((i * 2 + j + f) % 5)) - T(2);
+}
 
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P6 = algorithmStrassen(A21 - A11, B11 + B12);
+// Multiplies the chain of factors of sizes dims[f] x dims[f + 1], or raises
+// a size x size matrix to chain.power, and reports the time. Returns 1 if
+// the check fails.
+template <typename T>
+static int runChain(const chain_config& chain, std::size_t size,
+                    strassen_params params, const executor_config& exec) {
+  std::vector<matrix<T>> factors;
+  if (chain.power) {
+    factors.emplace_back(size, size);
+  } else {
+    for (std::size_t f = 0; f + 1 < chain.dims.size(); ++f)
+      factors.emplace_back(chain.dims[f], chain.dims[f + 1]);
+  }
+  std::vector<const_matrix_view<T>> views;
+  for (std::size_t f = 0; f < factors.size(); ++f) {
+    for (std::size_t i = 0; i < factors[f].nrows(); ++i)
+      for (std::size_t j = 0; j < factors[f].ncols(); ++j)
+        factors[f][i][j] = chainElement<T>(f, i, j);
+    views.push_back(factors[f].view());
+  }
 
-  #pragma omp task shared(P1, P2, P3, P4, P5, P6, P7)
-    P7 = algorithmStrassen(A12 - A22, B21 + B22);
+  chain_plan plan;
+  std::size_t scratch;
+  if (chain.power) {
+    scratch = strassenScratch<T>(size, size, size, params);
+  } else {
+    plan = planChain(views);
+    scratch = chainScratch<T>(plan, params);
+  }
+  matrix<T> C;
+  auto product = [&](workspace& ws) {
+    if (chain.power)
+      C = pow(views.front(), *chain.power, ws, params);
+    else
+      C = multiplyChain(views, ws, params);
+  };
 
-  #pragma omp taskwait
+  std::chrono::duration<double, std::milli> elapsed;
+  if (exec.pool) {
+    thread_pool pool{exec.threads, exec.pin};
+    params.pool = &pool;
+    workspace ws{scratch, pool.size()};
+    auto start = std::chrono::high_resolution_clock::now();
+    pool.run([&] { product(ws); });
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+  } else {
+    workspace ws{scratch, exec.threads};
+    auto start = std::chrono::high_resolution_clock::now();
+#pragma omp parallel num_threads(exec.threads)
+{
+  #pragma omp single nowait
+    product(ws);
+}
+    elapsed = std::chrono::high_resolution_clock::now() - start;
+  }
 
-  // Calculating the result submatrices.
-  matrix C11 = P1 + P4 - P5 + P7;
-  matrix C12 = P3 + P5;
-  matrix C21 = P2 + P4;
-  matrix C22 = P1 - P2 + P3 + P6;
+  if (chain.power)
+    std::cout << "Power " << *chain.power << " of a " << size << " x "
+              << size << " matrix" << std::endl;
+  else
+    std::cout << "Chain of " << plan.factors() << " factors, "
+              << plan.cost() << " multiply-adds in the chosen order"
+              << std::endl;
+  std::cout << "Calculation took " << elapsed.count() << "ms to run"
+            << std::endl;
+  if (!chain.check)
+    return 0;
 
-  matrix C{size, size};
-  combineSubmatrix(C, C11, C12, C21, C22);
+  matrix<T> expected;
+  if (chain.power && *chain.power == 0) {
+    expected = matrix<T>{size, size};
+    for (std::size_t i = 0; i < size; ++i)
+      expected[i][i] = T{1};
+  } else {
+    expected = factors.front();
+    for (unsigned long long f = 1;
+         f < (chain.power ? *chain.power : factors.size()); ++f)
+      expected = expected * factors[chain.power ? 0 : f];
+  }
+  std::size_t failed = 0;
+  for (std::size_t i = 0; i < C.nrows(); ++i)
+    for (std::size_t j = 0; j < C.ncols(); ++j)
+      failed += C[i][j] != expected[i][j];
+  std::cout << (failed ? "Check FAILED: " : "Check passed: ") << failed
+            << " wrong elements" << std::endl;
+  return failed ? 1 : 0;
+}
 
-  return C;
+// Name of an element type in --type.
+static std::string typeName(element_type type) {
+  switch (type) {
+    case element_type::int32:
+      return "int";
+    case element_type::int64:
+      return "long";
+    case element_type::float32:
+      return "float";
+    case element_type::float64:
+      return "double";
+    case element_type::modular32:
+      return "mod";
+  }
+  return "";
 }
 
 int main(int argc, char** argv) {
   std::size_t size = 8;
+  std::size_t m = 0, k = 0, n = 0;
+  strassen_params params;
+  executor_config exec;
+  io_config io;
+  profile_config prof;
+  tune_config tune;
+  chain_config chain;
+  std::string a_path, b_path;
 
   po::options_description desc("Allowed options");
   desc.add_options()("help", "produce help message")(
       "size", po::value<std::size_t>(&size),
-      "Size of the square matrix must be a power of two");
+      "Size of the square matrices")(
+      "m", po::value<std::size_t>(&m), "Rows of A and C (defaults to size)")(
+      "k", po::value<std::size_t>(&k),
+      "Columns of A and rows of B (defaults to size)")(
+      "n", po::value<std::size_t>(&n),
+      "Columns of B and C (defaults to size)")(
+      "leaf", po::value<std::size_t>(&params.leaf)->default_value(params.leaf),
+      "Size at or below which the recursion switches to the blocked kernel")(
+      "task-depth",
+      po::value<unsigned>(&params.task_depth)
+          ->default_value(params.task_depth),
+      "Recursion levels that spawn tasks")(
+      "executor", po::value<std::string>()->default_value("omp"),
+      "Runtime of the tasks: omp (OpenMP tasks) or pool (work-stealing "
+      "thread pool)")(
+      "threads", po::value<unsigned>(&exec.threads),
+      "Number of threads (defaults to the OpenMP maximum)")(
+      "pin", po::bool_switch(&exec.pin),
+      "Bind pool worker i to the i-th available CPU (for omp use "
+      "OMP_PROC_BIND and OMP_PLACES)")(
+      "variant", po::value<std::string>()->default_value("classic"),
+      "Formula of a recursion level: classic or winograd")(
+      "layout", po::value<std::string>()->default_value("row-major"),
+      "Storage of the recursion: row-major or morton (Z-order tiles)")(
+      "type", po::value<std::string>()->default_value("int"),
+      "Element type: int, long, float, double or mod (residues modulo "
+      "--modulus)")(
+      "modulus", po::value<std::uint64_t>(),
+      "p of --type mod, below 2^31 (defaults to 2^31 - 1, or to the p of "
+      "the input files)")(
+      "a", po::value<std::string>(&a_path),
+      "Matrix file with A (with --b; sizes and type come from the files)")(
+      "b", po::value<std::string>(&b_path), "Matrix file with B")(
+      "out", po::value<std::string>(&io.out), "Matrix file to write C to")(
+      "memory-budget", po::value<std::size_t>(),
+      "MiB a product may take in memory; larger ones run out of core on "
+      "scratch files")(
+      "scratch-dir",
+      po::value<std::string>(&io.scratch_dir)
+          ->default_value(std::filesystem::temp_directory_path()),
+      "Directory of the out-of-core scratch files")(
+      "profile", po::bool_switch(&prof.summary),
+      "Print time per phase, allocations, copies and tasks per recursion "
+      "level and per thread (builds with STRASSEN_PROFILE)")(
+      "trace", po::value<std::string>(&prof.trace),
+      "Write a Chrome trace-event JSON of the run (builds with "
+      "STRASSEN_PROFILE)")(
+      "autotune", po::bool_switch(&tune.autotune),
+      "Measure leaf size, task depth and tiles on this machine before the "
+      "run and save them for later runs")(
+      "tune-file",
+      po::value<std::string>(&tune.file)->default_value(defaultTuningFile()),
+      "Cache of tuned parameters, keyed by CPU model, threads and type")(
+      "chain", po::value(&chain.dims)->multitoken(),
+      "Multiply a chain of matrices instead: factor f is dims[f] x "
+      "dims[f + 1]")(
+      "pow", po::value<unsigned long long>(),
+      "Raise the size x size matrix to this power instead")(
+      "check", po::bool_switch(&chain.check),
+      "Compare the result of --chain or --pow with repeated operator*");
 
   po::variables_map vm;
   po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -117,20 +428,161 @@ int main(int argc, char** argv) {
     return 1;
   }
 
-  matrix A = matrix::square_unit(size);
-  matrix C {};
+  const auto& formula = vm["variant"].as<std::string>();
+  if (formula == "winograd") {
+    params.formula = variant::winograd;
+  } else if (formula != "classic") {
+    std::cerr << "Unknown --variant " << formula << std::endl;
+    return 1;
+  }
 
-  auto start = std::chrono::high_resolution_clock::now();
-#pragma omp parallel shared(A) 
-{
-  #pragma omp single nowait 
-		C = algorithmStrassen(A, A);
-}
-  auto  finish = std::chrono::high_resolution_clock::now();
+  const auto& storage = vm["layout"].as<std::string>();
+  if (storage == "morton") {
+    params.storage = layout::morton;
+  } else if (storage != "row-major") {
+    std::cerr << "Unknown --layout " << storage << std::endl;
+    return 1;
+  }
 
-  auto elapsed = std::chrono::duration<double, std::milli>(finish - start);
-  std::cout << "Calculation took " << elapsed.count() << "ms to run"
-            << std::endl;
+  const auto& executor = vm["executor"].as<std::string>();
+  if (executor == "pool") {
+    exec.pool = true;
+  } else if (executor != "omp") {
+    std::cerr << "Unknown --executor " << executor << std::endl;
+    return 1;
+  }
+  if (!vm.count("threads"))
+    exec.threads = workspace::defaultThreads();
+  if (exec.threads == 0) {
+    std::cerr << "--threads must be positive" << std::endl;
+    return 1;
+  }
+
+  if (params.leaf == 0) {
+    std::cerr << "--leaf must be positive" << std::endl;
+    return 1;
+  }
+
+  m = m ? m : size;
+  k = k ? k : size;
+  n = n ? n : size;
+  std::string type = vm["type"].as<std::string>();
+
+#ifndef STRASSEN_PROFILE
+  if (prof.summary || !prof.trace.empty()) {
+    std::cerr << "--profile and --trace need a build with STRASSEN_PROFILE"
+              << std::endl;
+    return 1;
+  }
+#endif
+
+  if (vm.count("memory-budget")) {
+    io.memory_budget = vm["memory-budget"].as<std::size_t>() << 20;
+    if (io.memory_budget == 0) {
+      std::cerr << "--memory-budget must be positive" << std::endl;
+      return 1;
+    }
+  }
+
+  if (vm.count("pow"))
+    chain.power = vm["pow"].as<unsigned long long>();
+  bool chained = !chain.dims.empty() || chain.power;
+  if (!chain.dims.empty() &&
+      (chain.power || chain.dims.size() < 2 ||
+       std::count(chain.dims.begin(), chain.dims.end(), 0))) {
+    std::cerr << "--chain takes two or more positive sizes, without --pow"
+              << std::endl;
+    return 1;
+  }
+  if (chained && (!a_path.empty() || !io.out.empty() || io.memory_budget ||
+                  tune.autotune)) {
+    std::cerr << "--chain and --pow do not take --a, --b, --out, "
+                 "--memory-budget or --autotune"
+              << std::endl;
+    return 1;
+  }
+  if (chain.check && !chained) {
+    std::cerr << "--check goes with --chain or --pow" << std::endl;
+    return 1;
+  }
+
+  if (a_path.empty() != b_path.empty()) {
+    std::cerr << "--a and --b go together" << std::endl;
+    return 1;
+  }
+
+  try {
+    if (vm.count("modulus"))
+      modular::setModulus(vm["modulus"].as<std::uint64_t>());
+
+    mapped_file a_file, b_file;
+    if (!a_path.empty()) {
+      a_file = mapped_file::open(a_path);
+      b_file = mapped_file::open(b_path);
+      const auto& a = matrixHeader(a_file);
+      const auto& b = matrixHeader(b_file);
+      if (a.type != b.type || a.cols != b.rows) {
+        std::cerr << "Unsuitable matrix files" << std::endl;
+        return 1;
+      }
+      if (a.modulus != b.modulus) {
+        std::cerr << "Matrix files hold residues modulo different p"
+                  << std::endl;
+        return 1;
+      }
+      m = a.rows;
+      k = a.cols;
+      n = b.cols;
+      type = typeName(a.type);
+      if (a.type == element_type::modular32 && !vm.count("modulus"))
+        modular::setModulus(a.modulus);
+      io.a = &a_file;
+      io.b = &b_file;
+    }
+
+    // Tuned values of an earlier --autotune, unless given on the command
+    // line.
+    tune.key = tuningKey(exec.threads, type);
+    tune.keep_leaf = !vm["leaf"].defaulted();
+    tune.keep_task_depth = !vm["task-depth"].defaulted();
+    if (!tune.autotune) {
+      if (auto tuned = loadTuning(tune.file, tune.key))
+        tuned->applyTo(params, tune.keep_leaf, tune.keep_task_depth);
+    }
+
+    if (chained) {
+      if (type == "int")
+        return runChain<int>(chain, size, params, exec);
+      if (type == "long")
+        return runChain<std::int64_t>(chain, size, params, exec);
+      if (type == "float")
+        return runChain<float>(chain, size, params, exec);
+      if (type == "double")
+        return runChain<double>(chain, size, params, exec);
+      if (type == "mod")
+        return runChain<modular>(chain, size, params, exec);
+      std::cerr << "Unknown --type " << type << std::endl;
+      return 1;
+    }
+
+    if (type == "int") {
+      run<int>(m, k, n, params, exec, io, prof, tune);
+    } else if (type == "long") {
+      run<std::int64_t>(m, k, n, params, exec, io, prof, tune);
+    } else if (type == "float") {
+      run<float>(m, k, n, params, exec, io, prof, tune);
+    } else if (type == "double") {
+      run<double>(m, k, n, params, exec, io, prof, tune);
+    } else if (type == "mod") {
+      run<modular>(m, k, n, params, exec, io, prof, tune);
+    } else {
+      std::cerr << "Unknown --type " << type << std::endl;
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << e.what() << std::endl;
+    return 1;
+  }
 
   return 0;
 }
@@ -0,0 +1,371 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <omp.h>
+#include "autotune.hpp"
+#include "batched.hpp"
+#include "matrix.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+// Sweep over sizes, thread counts, leaf cutoffs and algorithms. Every case is
+// run `warmup` times untimed and then `reps` times timed; the report gives
+// the median and the 95th percentile of the timed runs, the effective
+// GFLOP/s (2 n^3 over the median, whatever the algorithm actually does) and
+// the speedup and parallel efficiency against the single-thread run of the
+// same algorithm, size and leaf. That baseline is always measured, also when
+// 1 is not among --threads, and is marked as such in the report.
+//
+// strassen and winograd run in a parallel region of each thread count;
+// sequential is the Strassen recursion called directly on the main thread
+// with no task levels, so it does not depend on the thread count. naive is
+// the serial operator* and is timed at every thread count anyway, so its
+// rows show what the others gain over it.
+//
+// The Strassen algorithms take the tiles, and the leaf and task depth unless
+// given, from the --autotune cache entry of the thread count and type.
+//
+// The batched algorithm multiplies `batch` independent pairs of each size up
+// to the largest compiled batched kernel; its GFLOP/s cover the whole batch.
+
+struct bench_config {
+  std::vector<std::size_t> sizes;
+  std::vector<int> threads;
+  std::vector<std::size_t> leaves;
+  std::vector<std::string> algorithms;
+  unsigned task_depth = 3;
+  unsigned warmup = 1;
+  unsigned reps = 5;
+  std::size_t naive_max = 1024;
+  std::size_t batch = 1000;
+  std::string type;
+  std::string tune_file;
+  bool keep_leaf = false;
+  bool keep_task_depth = false;
+};
+
+struct bench_result {
+  std::string algorithm;
+  std::size_t size = 0;
+  int threads = 1;
+  std::size_t leaf = 0;
+  double median_ms = 0;
+  double p95_ms = 0;
+  double gflops = 0;
+  double speedup = 0;
+  double efficiency = 0;
+  // Leaf of the --leaf sweep the run belongs to; a tuned leaf may differ
+  // from it, and from one thread count to another.
+  std::size_t sweep_leaf = 0;
+  // The single-thread run the speedups of its group are measured against.
+  bool baseline = false;
+};
+
+template <typename F>
+static std::vector<double> measure(F&& f, unsigned warmup, unsigned reps) {
+  for (unsigned i = 0; i < warmup; ++i)
+    f();
+
+  std::vector<double> times;
+  for (unsigned i = 0; i < reps; ++i) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto finish = std::chrono::steady_clock::now();
+    times.push_back(
+        std::chrono::duration<double, std::milli>(finish - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  return times;
+}
+
+static double median(const std::vector<double>& sorted) {
+  std::size_t n = sorted.size();
+  return n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+}
+
+// Nearest-rank percentile.
+static double percentile(const std::vector<double>& sorted, double p) {
+  auto rank = static_cast<std::size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::clamp<std::size_t>(rank, 1, sorted.size()) - 1];
+}
+
+static bench_result summarize(std::string algorithm, std::size_t size,
+                              int threads, std::size_t leaf,
+                              const std::vector<double>& times,
+                              std::size_t products = 1) {
+  bench_result r{std::move(algorithm), size, threads, leaf};
+  r.median_ms = median(times);
+  r.p95_ms = percentile(times, 0.95);
+  r.gflops = 2.0 * size * size * size * products / (r.median_ms * 1e6);
+  return r;
+}
+
+template <typename T>
+static std::vector<bench_result> sweep(const bench_config& cfg) {
+  // The single-thread baseline first, whether asked for or not.
+  std::vector<int> thread_counts{1};
+  for (int threads : cfg.threads)
+    if (threads != 1)
+      thread_counts.push_back(threads);
+
+  std::vector<bench_result> results;
+  for (std::size_t size : cfg.sizes) {
+    matrix<T> A{size, size, T{1}}, B{size, size, T{1}};
+
+    for (const auto& algorithm : cfg.algorithms) {
+      if (algorithm == "naive") {
+        if (size > cfg.naive_max)
+          continue;
+        for (int threads : thread_counts) {
+          omp_set_num_threads(threads);
+          auto times = measure([&] { matrix<T> C = A * B; }, cfg.warmup,
+                               cfg.reps);
+          results.push_back(summarize(algorithm, size, threads, 0, times));
+        }
+        continue;
+      }
+
+      if (algorithm == "batched") {
+        if (size > std::end(batched_sizes)[-1])
+          continue;
+        std::size_t elements = size * size;
+        std::vector<T> As(cfg.batch * elements, T{1});
+        std::vector<T> Bs(cfg.batch * elements, T{1});
+        std::vector<T> Cs(cfg.batch * elements);
+        for (int threads : thread_counts) {
+          omp_set_num_threads(threads);
+          auto times = measure(
+              [&] {
+                multiplyBatched(
+                    matrix_batch<T>{Cs.data(), cfg.batch, size, size},
+                    const_matrix_batch<T>{As.data(), cfg.batch, size, size},
+                    const_matrix_batch<T>{Bs.data(), cfg.batch, size, size});
+              },
+              cfg.warmup, cfg.reps);
+          results.push_back(
+              summarize(algorithm, size, threads, 0, times, cfg.batch));
+        }
+        continue;
+      }
+
+      strassen_params base;
+      base.task_depth = cfg.task_depth;
+      if (algorithm == "winograd")
+        base.formula = variant::winograd;
+
+      for (std::size_t leaf : cfg.leaves) {
+        if (algorithm == "sequential") {
+          strassen_params params = base;
+          params.leaf = leaf;
+          if (auto tuned =
+                  loadTuning(cfg.tune_file, tuningKey(1, cfg.type)))
+            tuned->applyTo(params, cfg.keep_leaf, true);
+          params.task_depth = 0;
+          workspace ws{strassenScratch<T>(size, size, size, params), 1};
+          auto times = measure(
+              [&] { matrix<T> C = algorithmStrassen(A, B, ws, params); },
+              cfg.warmup, cfg.reps);
+          results.push_back(
+              summarize(algorithm, size, 1, params.leaf, times));
+          results.back().sweep_leaf = leaf;
+          continue;
+        }
+
+        for (int threads : thread_counts) {
+          strassen_params params = base;
+          params.leaf = leaf;
+          if (auto tuned = loadTuning(cfg.tune_file,
+                                      tuningKey(threads, cfg.type)))
+            tuned->applyTo(params, cfg.keep_leaf, cfg.keep_task_depth);
+          omp_set_num_threads(threads);
+          workspace ws{strassenScratch<T>(size, size, size, params)};
+          auto times = measure(
+              [&] {
+                matrix<T> C;
+#pragma omp parallel
+                {
+                  #pragma omp single nowait
+                    C = algorithmStrassen(A, B, ws, params);
+                }
+              },
+              cfg.warmup, cfg.reps);
+          results.push_back(
+              summarize(algorithm, size, threads, params.leaf, times));
+          results.back().sweep_leaf = leaf;
+        }
+      }
+    }
+  }
+
+  for (auto& r : results) {
+    auto serial = std::find_if(results.begin(), results.end(), [&](auto& s) {
+      return s.algorithm == r.algorithm && s.size == r.size &&
+             s.sweep_leaf == r.sweep_leaf && s.threads == 1;
+    });
+    if (serial == results.end())
+      continue;
+    r.baseline = &*serial == &r;
+    r.speedup = serial->median_ms / r.median_ms;
+    r.efficiency = r.speedup / r.threads;
+  }
+  return results;
+}
+
+static void printTable(std::ostream& os,
+                       const std::vector<bench_result>& results) {
+  os << std::left << std::setw(10) << "algorithm" << std::right
+     << std::setw(7) << "size" << std::setw(8) << "threads" << std::setw(6)
+     << "leaf" << std::setw(12) << "median ms" << std::setw(12) << "p95 ms"
+     << std::setw(9) << "GFLOP/s" << std::setw(9) << "speedup"
+     << std::setw(11) << "efficiency" << '\n';
+  os << std::fixed;
+  for (const auto& r : results) {
+    os << std::left << std::setw(10) << r.algorithm << std::right
+       << std::setw(7) << r.size << std::setw(8) << r.threads << std::setw(6)
+       << r.leaf << std::setprecision(2) << std::setw(12) << r.median_ms
+       << std::setw(12) << r.p95_ms << std::setw(9) << r.gflops
+       << std::setw(9) << r.speedup << std::setw(11) << r.efficiency
+       << (r.baseline ? "  baseline" : "") << '\n';
+  }
+}
+
+static void writeCsv(std::ostream& os, const std::string& type,
+                     const std::vector<bench_result>& results) {
+  os << "algorithm,type,size,threads,leaf,median_ms,p95_ms,gflops,speedup,"
+        "efficiency,baseline\n";
+  for (const auto& r : results) {
+    os << r.algorithm << ',' << type << ',' << r.size << ',' << r.threads
+       << ',' << r.leaf << ',' << r.median_ms << ',' << r.p95_ms << ','
+       << r.gflops << ',' << r.speedup << ',' << r.efficiency << ','
+       << r.baseline << '\n';
+  }
+}
+
+static void writeJson(std::ostream& os, const std::string& type,
+                      const std::vector<bench_result>& results) {
+  os << "[\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    os << "  {\"algorithm\": \"" << r.algorithm << "\", \"type\": \"" << type
+       << "\", \"size\": " << r.size << ", \"threads\": " << r.threads
+       << ", \"leaf\": " << r.leaf << ", \"median_ms\": " << r.median_ms
+       << ", \"p95_ms\": " << r.p95_ms << ", \"gflops\": " << r.gflops
+       << ", \"speedup\": " << r.speedup
+       << ", \"efficiency\": " << r.efficiency
+       << ", \"baseline\": " << (r.baseline ? "true" : "false") << "}"
+       << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "]\n";
+}
+
+int main(int argc, char** argv) {
+  bench_config cfg;
+  std::string& type = cfg.type;
+  std::string csv, json;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()("help", "produce help message")(
+      "sizes",
+      po::value(&cfg.sizes)
+          ->multitoken()
+          ->default_value({256, 512, 1024}, "256 512 1024"),
+      "Sizes of the square matrices")(
+      "threads",
+      po::value(&cfg.threads)
+          ->multitoken()
+          ->default_value({1, omp_get_max_threads()}, "1 <max>"),
+      "OpenMP thread counts")(
+      "leaf",
+      po::value(&cfg.leaves)->multitoken()->default_value({64}, "64"),
+      "Leaf cutoffs of the recursion")(
+      "algorithms",
+      po::value(&cfg.algorithms)
+          ->multitoken()
+          ->default_value({"naive", "sequential", "strassen", "winograd"},
+                          "naive sequential strassen winograd"),
+      "Algorithms: naive (operator*), sequential (Strassen on one thread, "
+      "no tasks), strassen, winograd, batched")(
+      "task-depth",
+      po::value<unsigned>(&cfg.task_depth)->default_value(cfg.task_depth),
+      "Recursion levels that spawn OpenMP tasks")(
+      "warmup", po::value<unsigned>(&cfg.warmup)->default_value(cfg.warmup),
+      "Untimed runs before measuring")(
+      "reps", po::value<unsigned>(&cfg.reps)->default_value(cfg.reps),
+      "Timed runs per case")(
+      "naive-max",
+      po::value<std::size_t>(&cfg.naive_max)->default_value(cfg.naive_max),
+      "Largest size the naive multiply is run for")(
+      "batch", po::value<std::size_t>(&cfg.batch)->default_value(cfg.batch),
+      "Products per run of the batched algorithm")(
+      "type", po::value<std::string>(&type)->default_value("double"),
+      "Element type: int, float or double")(
+      "csv", po::value<std::string>(&csv), "Write the results as CSV")(
+      "json", po::value<std::string>(&json), "Write the results as JSON")(
+      "tune-file",
+      po::value<std::string>(&cfg.tune_file)
+          ->default_value(defaultTuningFile()),
+      "Cache of tuned parameters written by parallel --autotune");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  if (vm.count("help")) {
+    std::cout << desc << "\n";
+    return 1;
+  }
+
+  cfg.keep_leaf = !vm["leaf"].defaulted();
+  cfg.keep_task_depth = !vm["task-depth"].defaulted();
+
+  if (cfg.reps == 0) {
+    std::cerr << "--reps must be positive" << std::endl;
+    return 1;
+  }
+  for (const auto& algorithm : cfg.algorithms) {
+    if (algorithm != "naive" && algorithm != "sequential" &&
+        algorithm != "strassen" && algorithm != "winograd" &&
+        algorithm != "batched") {
+      std::cerr << "Unknown algorithm " << algorithm << std::endl;
+      return 1;
+    }
+  }
+  if (std::count(cfg.leaves.begin(), cfg.leaves.end(), 0) ||
+      std::count_if(cfg.threads.begin(), cfg.threads.end(),
+                    [](int t) { return t < 1; })) {
+    std::cerr << "--leaf and --threads must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<bench_result> results;
+  if (type == "int") {
+    results = sweep<int>(cfg);
+  } else if (type == "float") {
+    results = sweep<float>(cfg);
+  } else if (type == "double") {
+    results = sweep<double>(cfg);
+  } else {
+    std::cerr << "Unknown --type " << type << std::endl;
+    return 1;
+  }
+
+  printTable(std::cout, results);
+  if (!csv.empty()) {
+    std::ofstream os{csv};
+    writeCsv(os, type, results);
+  }
+  if (!json.empty()) {
+    std::ofstream os{json};
+    writeJson(os, type, results);
+  }
+  return 0;
+}
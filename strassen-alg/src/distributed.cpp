@@ -0,0 +1,556 @@
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <mpi.h>
+#include <omp.h>
+#include "autotune.hpp"
+#include "matrix.hpp"
+#include "morton.hpp"
+#include "strassen.hpp"
+#include "workspace.hpp"
+
+#include <boost/program_options.hpp>
+
+namespace po = boost::program_options;
+
+// Strassen over MPI ranks in the style of CAPS (Ballard et al., 2012).
+//
+// The N x N operands are stored in the Morton layout of morton.hpp with one
+// level per distributed recursion step, so every quadrant is a contiguous
+// quarter of its parent and the leaves are row-major tiles. On a communicator
+// of P ranks, rank r owns chunk r of each of the four quadrants of A, B and
+// C. The operand sums of the seven products are then element-wise over local
+// chunks and need no communication.
+//
+// A breadth-first (BFS) step hands product i to the i-th seventh of the
+// ranks: one all-to-all moves the chunks of S_i and T_i into the layout of a
+// half-size problem on that group, the group recurses on its own
+// communicator, and a second all-to-all brings the chunks of the product back
+// for the local combination into C. A depth-first (DFS) step keeps all ranks
+// together and runs the seven products one after another, which needs less
+// memory: a BFS step grows the data per rank by 7/4. As in CAPS, the DFS
+// steps come first. Once a single rank is left it multiplies its tile with
+// the OpenMP Strassen of strassen.hpp.
+
+// Positions [lo, hi) of the flat storage of a matrix.
+struct interval {
+  std::size_t lo = 0;
+  std::size_t hi = 0;
+};
+
+// Chunk `part` of `parts` nearly equal chunks of [0, len).
+static interval chunk(std::size_t len, int parts, int part) {
+  return {len * part / parts, len * (part + 1) / parts};
+}
+
+// Distribution of a flat matrix of length len over the ranks
+// [first, first + ranks) of a communicator: every rank owns its chunk of each
+// of the `pieces` equal pieces of the matrix, stored one after the other.
+// pieces is 4 (the quadrants) for matrices that are split further, and 1 for
+// the row-major leaf tiles.
+struct ownership {
+  std::size_t len = 0;
+  unsigned pieces = 1;
+  int first = 0;
+  int ranks = 1;
+
+  bool owns(int rank) const { return rank >= first && rank < first + ranks; }
+
+  std::vector<interval> of(int rank) const {
+    std::vector<interval> owned;
+    std::size_t piece = len / pieces;
+    for (unsigned p = 0; p < pieces; ++p) {
+      interval c = chunk(piece, ranks, rank - first);
+      owned.push_back({p * piece + c.lo, p * piece + c.hi});
+    }
+    return owned;
+  }
+
+  std::size_t localSize(int rank) const {
+    std::size_t size = 0;
+    for (auto [lo, hi] : of(rank))
+      size += hi - lo;
+    return size;
+  }
+};
+
+// Calls f(count, a_offset, b_offset) for every overlap of an interval of as
+// with one of bs; the offsets locate the overlap in the concatenated storage
+// of as and of bs.
+template <typename F>
+static void forEachOverlap(const std::vector<interval>& as,
+                           const std::vector<interval>& bs, F&& f) {
+  std::size_t a_base = 0;
+  for (auto a : as) {
+    std::size_t b_base = 0;
+    for (auto b : bs) {
+      std::size_t lo = std::max(a.lo, b.lo), hi = std::min(a.hi, b.hi);
+      if (lo < hi)
+        f(hi - lo, a_base + lo - a.lo, b_base + lo - b.lo);
+      b_base += b.hi - b.lo;
+    }
+    a_base += a.hi - a.lo;
+  }
+}
+
+template <typename T>
+MPI_Datatype mpiType();
+template <>
+MPI_Datatype mpiType<int>() { return MPI_INT; }
+template <>
+MPI_Datatype mpiType<std::int64_t>() { return MPI_INT64_T; }
+template <>
+MPI_Datatype mpiType<float>() { return MPI_FLOAT; }
+template <>
+MPI_Datatype mpiType<double>() { return MPI_DOUBLE; }
+
+// One matrix moving from the distribution src to dst. src_data holds this
+// rank's part under src, dst_data receives its part under dst; either is
+// ignored when the rank has no part.
+template <typename T>
+struct transfer {
+  ownership src;
+  ownership dst;
+  const T* src_data = nullptr;
+  T* dst_data = nullptr;
+};
+
+static std::vector<int> toDisplacements(const std::vector<std::size_t>& counts,
+                                        std::vector<int>& int_counts) {
+  std::vector<int> displs(counts.size());
+  std::size_t total = 0;
+  for (std::size_t i = 0; i < counts.size(); ++i) {
+    if (total + counts[i] > INT_MAX)
+      throw std::runtime_error("Redistribution exceeds MPI message limits");
+    int_counts[i] = static_cast<int>(counts[i]);
+    displs[i] = static_cast<int>(total);
+    total += counts[i];
+  }
+  return displs;
+}
+
+// Performs all transfers with a single all-to-all on comm.
+template <typename T>
+static void redistribute(MPI_Comm comm,
+                         const std::vector<transfer<T>>& transfers) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+
+  // Both sides enumerate the overlaps of a (sender, receiver) pair in the
+  // same order, so the messages need no headers.
+  auto outgoing = [&](int peer, auto&& f) {
+    for (const auto& t : transfers)
+      if (t.src.owns(rank) && t.dst.owns(peer))
+        forEachOverlap(t.src.of(rank), t.dst.of(peer),
+                       [&](std::size_t count, std::size_t at, std::size_t) {
+                         f(t, count, at);
+                       });
+  };
+  auto incoming = [&](int peer, auto&& f) {
+    for (const auto& t : transfers)
+      if (t.src.owns(peer) && t.dst.owns(rank))
+        forEachOverlap(t.src.of(peer), t.dst.of(rank),
+                       [&](std::size_t count, std::size_t, std::size_t at) {
+                         f(t, count, at);
+                       });
+  };
+
+  std::vector<std::size_t> send_sizes(size), recv_sizes(size);
+  for (int peer = 0; peer < size; ++peer) {
+    outgoing(peer, [&](auto&, std::size_t count, std::size_t) {
+      send_sizes[peer] += count;
+    });
+    incoming(peer, [&](auto&, std::size_t count, std::size_t) {
+      recv_sizes[peer] += count;
+    });
+  }
+  std::vector<int> send_counts(size), recv_counts(size);
+  auto send_displs = toDisplacements(send_sizes, send_counts);
+  auto recv_displs = toDisplacements(recv_sizes, recv_counts);
+
+  std::vector<T> send(send_displs.back() + send_counts.back());
+  std::vector<T> recv(recv_displs.back() + recv_counts.back());
+  for (int peer = 0; peer < size; ++peer) {
+    T* out = send.data() + send_displs[peer];
+    outgoing(peer, [&](const transfer<T>& t, std::size_t count,
+                       std::size_t at) {
+      out = std::copy(t.src_data + at, t.src_data + at + count, out);
+    });
+  }
+
+  MPI_Alltoallv(send.data(), send_counts.data(), send_displs.data(),
+                mpiType<T>(), recv.data(), recv_counts.data(),
+                recv_displs.data(), mpiType<T>(), comm);
+
+  for (int peer = 0; peer < size; ++peer) {
+    const T* in = recv.data() + recv_displs[peer];
+    incoming(peer, [&](const transfer<T>& t, std::size_t count,
+                       std::size_t at) {
+      std::copy(in, in + count, t.dst_data + at);
+      in += count;
+    });
+  }
+}
+
+// Signs of the quadrants 11, 12, 21, 22 of A and B in the operands of the
+// seven classic Strassen products, and of the products in the quadrants of C.
+constexpr int a_signs[7][4] = {{1, 0, 0, 1},  {0, 0, 1, 1}, {1, 0, 0, 0},
+                               {0, 0, 0, 1},  {1, 1, 0, 0}, {-1, 0, 1, 0},
+                               {0, 1, 0, -1}};
+constexpr int b_signs[7][4] = {{1, 0, 0, 1}, {1, 0, 0, 0},  {0, 1, 0, -1},
+                               {-1, 0, 1, 0}, {0, 0, 0, 1}, {1, 1, 0, 0},
+                               {0, 0, 1, 1}};
+constexpr int c_signs[7][4] = {{1, 0, 0, 1},  {0, 0, 1, -1}, {0, 1, 0, 1},
+                               {1, 0, 1, 0},  {-1, 1, 0, 0}, {0, 0, 0, 1},
+                               {1, 0, 0, 0}};
+
+// dest[0:len] = sum over q of signs[q] * quadrants[q * len + 0:len].
+template <typename T>
+static void combine(T* dest, const T* quadrants, std::size_t len,
+                    const int (&signs)[4]) {
+  using W = kernel_t<T>;
+  std::fill(dest, dest + len, T{});
+  for (unsigned q = 0; q < 4; ++q) {
+    const T* src = quadrants + q * len;
+    if (signs[q] > 0) {
+#pragma omp simd
+      for (std::size_t e = 0; e < len; ++e)
+        dest[e] = T(W(dest[e]) + W(src[e]));
+    } else if (signs[q] < 0) {
+#pragma omp simd
+      for (std::size_t e = 0; e < len; ++e)
+        dest[e] = T(W(dest[e]) - W(src[e]));
+    }
+  }
+}
+
+// C quadrants [0:4 * len] += the contributions of product i [0:len].
+template <typename T>
+static void accumulate(T* quadrants, const T* product, std::size_t len,
+                       const int (&signs)[4]) {
+  using W = kernel_t<T>;
+  for (unsigned q = 0; q < 4; ++q) {
+    T* dest = quadrants + q * len;
+    if (signs[q] > 0) {
+#pragma omp simd
+      for (std::size_t e = 0; e < len; ++e)
+        dest[e] = T(W(dest[e]) + W(product[e]));
+    } else if (signs[q] < 0) {
+#pragma omp simd
+      for (std::size_t e = 0; e < len; ++e)
+        dest[e] = T(W(dest[e]) - W(product[e]));
+    }
+  }
+}
+
+// The single-rank multiply at the bottom of the distribution.
+template <typename T>
+struct local_multiply {
+  std::size_t tile;
+  strassen_params params;
+  workspace ws;
+
+  local_multiply(std::size_t tile, const strassen_params& params)
+      : tile{tile}, params{params},
+        ws{strassenScratch<T>(tile, tile, tile, params)} {}
+
+  void operator()(const std::vector<T>& A, const std::vector<T>& B,
+                  std::vector<T>& C) {
+    C.assign(tile * tile, T{});
+    const_matrix_view<T> a{A.data(), tile, tile, tile};
+    const_matrix_view<T> b{B.data(), tile, tile, tile};
+    matrix_view<T> c{C.data(), tile, tile, tile};
+#pragma omp parallel
+    {
+      #pragma omp single nowait
+        algorithmStrassen(a, b, c, ws, params, 0);
+    }
+  }
+};
+
+// Distribution of the n x n operands of a step on `ranks` ranks with `dfs`
+// depth-first steps still to go.
+static ownership operandOwnership(std::size_t n, int ranks, unsigned dfs) {
+  bool leaf = ranks == 1 && dfs == 0;
+  return ownership{n * n, leaf ? 1u : 4u, 0, ranks};
+}
+
+// C = A * B for n x n matrices distributed over comm as operandOwnership()
+// describes. A and B hold this rank's part; C receives it.
+template <typename T>
+static void multiplyDistributed(MPI_Comm comm, std::size_t n, unsigned dfs,
+                                const std::vector<T>& A,
+                                const std::vector<T>& B, std::vector<T>& C,
+                                local_multiply<T>& local) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  if (size == 1 && dfs == 0) {
+    local(A, B, C);
+    return;
+  }
+
+  std::size_t quarter = n * n / 4;
+  interval own = chunk(quarter, size, rank);
+  std::size_t len = own.hi - own.lo;
+  // An operand of a product, as its parent holds it: chunk r of one quadrant.
+  ownership parent{quarter, 1, 0, size};
+  C.assign(4 * len, T{});
+
+  if (dfs > 0) {
+    ownership child = operandOwnership(n / 2, size, dfs - 1);
+    std::vector<T> s(len), t(len), product(len);
+    for (int i = 0; i < 7; ++i) {
+      combine(s.data(), A.data(), len, a_signs[i]);
+      combine(t.data(), B.data(), len, b_signs[i]);
+      std::vector<T> child_a(child.localSize(rank));
+      std::vector<T> child_b(child.localSize(rank));
+      std::vector<T> child_c;
+      redistribute<T>(comm, {{parent, child, s.data(), child_a.data()},
+                             {parent, child, t.data(), child_b.data()}});
+      multiplyDistributed(comm, n / 2, dfs - 1, child_a, child_b, child_c,
+                          local);
+      redistribute<T>(comm, {{child, parent, child_c.data(), product.data()}});
+      accumulate(C.data(), product.data(), len, c_signs[i]);
+    }
+    return;
+  }
+
+  if (size % 7 != 0)
+    throw std::runtime_error("Rank count is not a power of 7");
+  int group_size = size / 7, group = rank / group_size;
+  auto child = [&](int i) {
+    ownership o = operandOwnership(n / 2, group_size, 0);
+    o.first = i * group_size;
+    return o;
+  };
+
+  std::vector<T> child_a(child(group).localSize(rank));
+  std::vector<T> child_b(child(group).localSize(rank));
+  {
+    std::vector<T> s(7 * len), t(7 * len);
+    std::vector<transfer<T>> operands;
+    for (int i = 0; i < 7; ++i) {
+      combine(s.data() + i * len, A.data(), len, a_signs[i]);
+      combine(t.data() + i * len, B.data(), len, b_signs[i]);
+      operands.push_back({parent, child(i), s.data() + i * len,
+                          i == group ? child_a.data() : nullptr});
+      operands.push_back({parent, child(i), t.data() + i * len,
+                          i == group ? child_b.data() : nullptr});
+    }
+    redistribute(comm, operands);
+  }
+
+  MPI_Comm group_comm;
+  MPI_Comm_split(comm, group, rank, &group_comm);
+  std::vector<T> child_c;
+  multiplyDistributed(group_comm, n / 2, 0, child_a, child_b, child_c, local);
+  MPI_Comm_free(&group_comm);
+  child_a = {};
+  child_b = {};
+
+  std::vector<T> products(7 * len);
+  std::vector<transfer<T>> results;
+  for (int i = 0; i < 7; ++i)
+    results.push_back({child(i), parent,
+                       i == group ? child_c.data() : nullptr,
+                       products.data() + i * len});
+  redistribute(comm, results);
+  for (int i = 0; i < 7; ++i)
+    accumulate(C.data(), products.data() + i * len, len, c_signs[i]);
+}
+
+// Element (i, j) at flat position pos of an N x N Morton grid with the given
+// tile side.
+static std::pair<std::size_t, std::size_t> elementAt(std::size_t pos,
+                                                     std::size_t tile) {
+  auto [bi, bj] = mortonTile(pos / (tile * tile));
+  std::size_t within = pos % (tile * tile);
+  return {bi * tile + within / tile, bj * tile + within % tile};
+}
+
+// Test operands with small integer entries, so every product is exact in
+// all element types; zero outside size x size.
+template <typename T>
+static T elementA(std::size_t i, std::size_t j, std::size_t size) {
+  return i < size && j < size ? T((i * 3 + j * 5) % 7) - T(3) : T{};
+}
+
+template <typename T>
+static T elementB(std::size_t i, std::size_t j, std::size_t size) {
+  return i < size && j < size ? T((i * 2 + j) % 5) - T(2) : T{};
+}
+
+template <typename T>
+static int run(std::size_t size, unsigned dfs, const strassen_params& params,
+               bool check) {
+  int rank, ranks;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+
+  unsigned bfs = 0;
+  for (int p = ranks; p > 1; p /= 7, ++bfs) {
+    if (p % 7 != 0) {
+      if (rank == 0)
+        std::cerr << "The number of ranks must be a power of 7" << std::endl;
+      return 1;
+    }
+  }
+
+  // One Morton level per distributed step; the grid is padded to a multiple
+  // of 2^levels.
+  unsigned levels = bfs + dfs;
+  std::size_t tile = ((size + (std::size_t{1} << levels) - 1) >> levels);
+  std::size_t n = tile << levels;
+
+  ownership top = operandOwnership(n, ranks, dfs);
+  std::vector<T> A, B, C;
+  for (auto [lo, hi] : top.of(rank)) {
+    for (std::size_t pos = lo; pos < hi; ++pos) {
+      auto [i, j] = elementAt(pos, tile);
+      A.push_back(elementA<T>(i, j, size));
+      B.push_back(elementB<T>(i, j, size));
+    }
+  }
+  local_multiply<T> local{tile, params};
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  double start = MPI_Wtime();
+  multiplyDistributed(MPI_COMM_WORLD, n, dfs, A, B, C, local);
+  double elapsed = MPI_Wtime() - start, slowest = 0;
+  MPI_Reduce(&elapsed, &slowest, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    std::cout << "Ranks: " << ranks << " (" << bfs << " BFS, " << dfs
+              << " DFS steps), leaf tiles " << tile << " x " << tile
+              << std::endl;
+    std::cout << "Calculation took " << slowest * 1e3 << "ms to run"
+              << std::endl;
+  }
+  if (!check)
+    return 0;
+
+  // Gather C on rank 0 and compare it with the naive product there.
+  int local_size = static_cast<int>(C.size());
+  std::vector<int> sizes(ranks), displs(ranks);
+  MPI_Gather(&local_size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0,
+             MPI_COMM_WORLD);
+  for (int r = 1; r < ranks; ++r)
+    displs[r] = displs[r - 1] + sizes[r - 1];
+  std::vector<T> gathered(rank == 0 ? displs.back() + sizes.back() : 0);
+  MPI_Gatherv(C.data(), local_size, mpiType<T>(), gathered.data(),
+              sizes.data(), displs.data(), mpiType<T>(), 0, MPI_COMM_WORLD);
+
+  int failed = 0;
+  if (rank == 0) {
+    matrix<T> a{size, size}, b{size, size};
+    for (std::size_t i = 0; i < size; ++i) {
+      for (std::size_t j = 0; j < size; ++j) {
+        a[i][j] = elementA<T>(i, j, size);
+        b[i][j] = elementB<T>(i, j, size);
+      }
+    }
+    matrix<T> expected = a * b;
+
+    const T* value = gathered.data();
+    for (int r = 0; r < ranks; ++r) {
+      for (auto [lo, hi] : top.of(r)) {
+        for (std::size_t pos = lo; pos < hi; ++pos, ++value) {
+          auto [i, j] = elementAt(pos, tile);
+          T want = i < size && j < size ? expected[i][j] : T{};
+          failed += *value != want;
+        }
+      }
+    }
+    std::cout << (failed ? "Check FAILED: " : "Check passed: ") << failed
+              << " wrong elements" << std::endl;
+  }
+  MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  return failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+  MPI_Init(&argc, &argv);
+  int rank;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  std::size_t size = 8;
+  unsigned dfs = 0;
+  strassen_params params;
+  std::string tune_file;
+
+  po::options_description desc("Allowed options");
+  desc.add_options()("help", "produce help message")(
+      "size", po::value<std::size_t>(&size), "Size of the square matrices")(
+      "dfs", po::value<unsigned>(&dfs)->default_value(dfs),
+      "Depth-first distributed steps before the breadth-first ones")(
+      "leaf", po::value<std::size_t>(&params.leaf)->default_value(params.leaf),
+      "Size at or below which the local recursion switches to the blocked "
+      "kernel")(
+      "task-depth",
+      po::value<unsigned>(&params.task_depth)
+          ->default_value(params.task_depth),
+      "Local recursion levels that spawn OpenMP tasks")(
+      "variant", po::value<std::string>()->default_value("classic"),
+      "Formula of a local recursion level: classic or winograd")(
+      "type", po::value<std::string>()->default_value("double"),
+      "Element type: int, long, float or double")(
+      "check", "Gather C on rank 0 and compare it with the naive product")(
+      "tune-file",
+      po::value<std::string>(&tune_file)->default_value(defaultTuningFile()),
+      "Cache of tuned parameters written by parallel --autotune; the local "
+      "multiplies use the entry of their thread count and type");
+
+  po::variables_map vm;
+  po::store(po::parse_command_line(argc, argv, desc), vm);
+  po::notify(vm);
+
+  int status = 0;
+  const auto& formula = vm["variant"].as<std::string>();
+  const auto& type = vm["type"].as<std::string>();
+  if (vm.count("help")) {
+    if (rank == 0)
+      std::cout << desc << "\n";
+    status = 1;
+  } else if (formula != "classic" && formula != "winograd") {
+    if (rank == 0)
+      std::cerr << "Unknown --variant " << formula << std::endl;
+    status = 1;
+  } else if (params.leaf == 0) {
+    if (rank == 0)
+      std::cerr << "--leaf must be positive" << std::endl;
+    status = 1;
+  } else {
+    if (formula == "winograd")
+      params.formula = variant::winograd;
+    // Tuned values of an earlier --autotune, unless given on the command
+    // line.
+    if (auto tuned =
+            loadTuning(tune_file, tuningKey(omp_get_max_threads(), type)))
+      tuned->applyTo(params, !vm["leaf"].defaulted(),
+                     !vm["task-depth"].defaulted());
+    bool check = vm.count("check");
+    if (type == "int") {
+      status = run<int>(size, dfs, params, check);
+    } else if (type == "long") {
+      status = run<std::int64_t>(size, dfs, params, check);
+    } else if (type == "float") {
+      status = run<float>(size, dfs, params, check);
+    } else if (type == "double") {
+      status = run<double>(size, dfs, params, check);
+    } else {
+      if (rank == 0)
+        std::cerr << "Unknown --type " << type << std::endl;
+      status = 1;
+    }
+  }
+
+  MPI_Finalize();
+  return status;
+}